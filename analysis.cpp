@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+#include "analysis.hpp"
+
+namespace ColorMap {
+
+static const double pi = 3.14159265358979323846;
+static const double deg = pi / 180.0;
+
+float DeltaE76(const float* lab0, const float* lab1)
+{
+    float dl = lab1[0] - lab0[0];
+    float da = lab1[1] - lab0[1];
+    float db = lab1[2] - lab0[2];
+    return std::sqrt(dl * dl + da * da + db * db);
+}
+
+/* CIEDE2000 as described in G. Sharma, W. Wu, E. N. Dalal: The CIEDE2000
+ * color-difference formula: Implementation notes, supplementary test data, and
+ * mathematical observations. Color Research & Application 30(1), 2005. */
+float DeltaE2000(const float* lab0, const float* lab1)
+{
+    double l1 = lab0[0], a1 = lab0[1], b1 = lab0[2];
+    double l2 = lab1[0], a2 = lab1[1], b2 = lab1[2];
+    const double pow25_7 = 6103515625.0;
+
+    double c_mean = 0.5 * (std::hypot(a1, b1) + std::hypot(a2, b2));
+    double c_mean7 = std::pow(c_mean, 7.0);
+    double g = 0.5 * (1.0 - std::sqrt(c_mean7 / (c_mean7 + pow25_7)));
+    double a1p = (1.0 + g) * a1;
+    double a2p = (1.0 + g) * a2;
+    double c1p = std::hypot(a1p, b1);
+    double c2p = std::hypot(a2p, b2);
+    double h1p = (a1p == 0.0 && b1 == 0.0 ? 0.0 : std::atan2(b1, a1p));
+    if (h1p < 0.0)
+        h1p += 2.0 * pi;
+    double h2p = (a2p == 0.0 && b2 == 0.0 ? 0.0 : std::atan2(b2, a2p));
+    if (h2p < 0.0)
+        h2p += 2.0 * pi;
+
+    double dlp = l2 - l1;
+    double dcp = c2p - c1p;
+    double dhp = 0.0;
+    if (c1p * c2p != 0.0) {
+        dhp = h2p - h1p;
+        if (dhp > pi)
+            dhp -= 2.0 * pi;
+        else if (dhp < -pi)
+            dhp += 2.0 * pi;
+    }
+    double dHp = 2.0 * std::sqrt(c1p * c2p) * std::sin(0.5 * dhp);
+
+    double lp_mean = 0.5 * (l1 + l2);
+    double cp_mean = 0.5 * (c1p + c2p);
+    double hp_mean = h1p + h2p;
+    if (c1p * c2p != 0.0) {
+        if (std::fabs(h1p - h2p) <= pi)
+            hp_mean = 0.5 * (h1p + h2p);
+        else if (h1p + h2p < 2.0 * pi)
+            hp_mean = 0.5 * (h1p + h2p + 2.0 * pi);
+        else
+            hp_mean = 0.5 * (h1p + h2p - 2.0 * pi);
+    }
+    double t = 1.0 - 0.17 * std::cos(hp_mean - 30.0 * deg) + 0.24 * std::cos(2.0 * hp_mean)
+        + 0.32 * std::cos(3.0 * hp_mean + 6.0 * deg) - 0.20 * std::cos(4.0 * hp_mean - 63.0 * deg);
+    double x = (hp_mean / deg - 275.0) / 25.0;
+    double dtheta = 30.0 * deg * std::exp(-x * x);
+    double cp_mean7 = std::pow(cp_mean, 7.0);
+    double rc = 2.0 * std::sqrt(cp_mean7 / (cp_mean7 + pow25_7));
+    double l50 = (lp_mean - 50.0) * (lp_mean - 50.0);
+    double sl = 1.0 + 0.015 * l50 / std::sqrt(20.0 + l50);
+    double sc = 1.0 + 0.045 * cp_mean;
+    double sh = 1.0 + 0.015 * cp_mean * t;
+    double rt = -std::sin(2.0 * dtheta) * rc;
+
+    double dl = dlp / sl;
+    double dc = dcp / sc;
+    double dh = dHp / sh;
+    return std::sqrt(dl * dl + dc * dc + dh * dh + rt * dc * dh);
+}
+
+static float to_float(unsigned char x) { return x / 255.0f; }
+static float to_float(float x) { return x; }
+
+template<typename T> struct analysis_job {
+    int n;
+    const T* srgb;
+    float* lab;
+    float* delta_e76;
+    float* delta_e2000;
+};
+
+// Convert the colors [begin,end) to CIELAB
+template<typename T> static void convert_colors(void* data, int begin, int end)
+{
+    const analysis_job<T>* j = static_cast<const analysis_job<T>*>(data);
+    const int block = 256;
+    float srgb[3 * block];
+    for (int i = begin; i < end; i += block) {
+        int count = std::min(block, end - i);
+        for (int k = 0; k < 3 * count; k++)
+            srgb[k] = to_float(j->srgb[3 * i + k]);
+        SRGBToLAB(count, srgb, j->lab + 3 * i);
+    }
+}
+
+// Compute the differences [begin,end) between colors i and i+1
+template<typename T> static void compute_steps(void* data, int begin, int end)
+{
+    const analysis_job<T>* j = static_cast<const analysis_job<T>*>(data);
+    const float* lab = j->lab;
+    for (int i = begin; i < end; i++)
+        j->delta_e76[i] = DeltaE76(lab + 3 * i, lab + 3 * (i + 1));
+    for (int i = begin; i < end; i++)
+        j->delta_e2000[i] = DeltaE2000(lab + 3 * i, lab + 3 * (i + 1));
+}
+
+float StepUniformity(int steps, const float* delta_e)
+{
+    double sum = 0.0, sum2 = 0.0;
+    for (int i = 0; i < steps; i++) {
+        double d = delta_e[i];
+        sum += d;
+        sum2 += d * d;
+    }
+    double mean = (steps > 0 ? sum / steps : 0.0);
+    if (mean <= 0.0)
+        return 0.0f;
+    double variance = sum2 / steps - mean * mean;
+    return std::sqrt(variance > 0.0 ? variance : 0.0) / mean;
+}
+
+// Summarize the differences of n-1 steps
+static void summarize(int steps, const float* delta_e, float& min_delta_e, float& max_delta_e,
+        float& mean_delta_e, float& arc_length, float& uniformity)
+{
+    double sum = 0.0;
+    float lo = delta_e[0], hi = delta_e[0];
+    for (int i = 0; i < steps; i++) {
+        sum += delta_e[i];
+        lo = std::min(lo, delta_e[i]);
+        hi = std::max(hi, delta_e[i]);
+    }
+    min_delta_e = lo;
+    max_delta_e = hi;
+    mean_delta_e = sum / steps;
+    arc_length = sum;
+    uniformity = StepUniformity(steps, delta_e);
+}
+
+template<typename T>
+Analysis Analyze(int n, const T* srgb_colormap, float* delta_e76, float* delta_e2000)
+{
+    Analysis a = Analysis();
+    a.n = n;
+    a.clipped = -1;
+    if (n < 1)
+        return a;
+
+    std::vector<float> lab(3 * n);
+    std::vector<float> steps76, steps2000;
+    if (!delta_e76) {
+        steps76.resize(n);
+        delta_e76 = steps76.data();
+    }
+    if (!delta_e2000) {
+        steps2000.resize(n);
+        delta_e2000 = steps2000.data();
+    }
+    analysis_job<T> j;
+    j.n = n;
+    j.srgb = srgb_colormap;
+    j.lab = lab.data();
+    j.delta_e76 = delta_e76;
+    j.delta_e2000 = delta_e2000;
+    ParallelFor(n, 4096, convert_colors<T>, &j);
+    ParallelFor(n - 1, 1024, compute_steps<T>, &j);
+
+    if (n > 1) {
+        summarize(n - 1, delta_e76, a.min_delta_e76, a.max_delta_e76, a.mean_delta_e76,
+                a.arc_length76, a.uniformity76);
+        summarize(n - 1, delta_e2000, a.min_delta_e2000, a.max_delta_e2000, a.mean_delta_e2000,
+                a.arc_length2000, a.uniformity2000);
+    }
+    a.min_lightness = a.max_lightness = lab[0];
+    int direction = 0;
+    bool increases = false, decreases = false;
+    for (int i = 1; i < n; i++) {
+        float l = lab[3 * i];
+        a.min_lightness = std::min(a.min_lightness, l);
+        a.max_lightness = std::max(a.max_lightness, l);
+        float dl = l - lab[3 * (i - 1)];
+        int d = (dl > 0.0f ? 1 : dl < 0.0f ? -1 : 0);
+        if (d == 0)
+            continue;
+        if (direction != 0 && d != direction)
+            a.lightness_reversals++;
+        direction = d;
+        if (d > 0)
+            increases = true;
+        else
+            decreases = true;
+    }
+    a.lightness_direction = (increases && !decreases ? 1 : decreases && !increases ? -1 : 0);
+    return a;
+}
+
+Analysis Analyze(const Parameters& parameters, float* delta_e76, float* delta_e2000)
+{
+    std::vector<float> colormap(3 * std::max(parameters.n, 0));
+    int clipped = Generate(parameters, colormap.data());
+    Analysis a = Analyze(parameters.n, colormap.data(), delta_e76, delta_e2000);
+    a.clipped = clipped;
+    return a;
+}
+
+template Analysis Analyze(int, const unsigned char*, float*, float*);
+template Analysis Analyze(int, const float*, float*, float*);
+
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_ANALYSIS_HPP
+#define COLORMAP_ANALYSIS_HPP
+
+#include "colormap.hpp"
+
+/* Color map analysis.
+ *
+ * These functions measure how perceptually uniform a color map is: the color
+ * differences between neighboring entries in CIELAB, both as the Euclidean
+ * distance (CIE76) and as CIEDE2000, the arc length of the map (the sum of
+ * these differences), and whether the lightness is monotonic.
+ *
+ * Large maps are split into chunks that are analyzed in parallel on the pool
+ * of the calling thread or the global thread pool (see SetThreads() in
+ * colormap.hpp).
+ */
+
+namespace ColorMap {
+
+struct Analysis {
+    int n;                      // number of colors
+    int clipped;                // number of clipped colors, or -1 if unknown
+
+    // Color differences between neighboring colors
+    float min_delta_e76, max_delta_e76, mean_delta_e76;
+    float min_delta_e2000, max_delta_e2000, mean_delta_e2000;
+    // Total length of the color map, i.e. the sum of the differences
+    float arc_length76, arc_length2000;
+    // Coefficient of variation (standard deviation divided by mean) of the
+    // differences; 0 is perfectly uniform. uniformity76 is the measure of
+    // Uniformity() in sweep.hpp.
+    float uniformity76, uniformity2000;
+
+    // The CIELAB lightness range, and the direction of the lightness: 1 if it
+    // never decreases, -1 if it never increases, 0 if it is constant or changes
+    // direction. Reversals counts how often it changes direction.
+    float min_lightness, max_lightness;
+    int lightness_direction;
+    int lightness_reversals;
+};
+
+// The color difference of two CIELAB colors
+float DeltaE76(const float* lab0, const float* lab1);
+float DeltaE2000(const float* lab0, const float* lab1);
+
+// The coefficient of variation of the given color differences, as in the
+// uniformity fields of Analysis; 0 if there are none or all are zero
+float StepUniformity(int steps, const float* delta_e);
+
+// Analyze a color map with n sRGB colors, either as unsigned char in [0,255]
+// or as float in [0,1]. If the arrays are not NULL, the n-1 differences between
+// neighboring colors i and i+1 are stored in them. The clipped field of the
+// result is -1.
+template<typename T>
+Analysis Analyze(int n, const T* srgb_colormap,
+        float* delta_e76 = NULL, float* delta_e2000 = NULL);
+
+// Generate the color map described by the parameters with float precision and
+// analyze it. The clipped field of the result is the return value of
+// Generate().
+Analysis Analyze(const Parameters& parameters,
+        float* delta_e76 = NULL, float* delta_e2000 = NULL);
+
+}
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <cstddef>
+
+#include "colormap.hpp"
+#include "apply.hpp"
+
+/* The loops that compute color map positions are simple enough to be
+ * vectorized by the compiler. As in colormap.cpp, they are compiled for
+ * several instruction set extensions on x86-64 Linux, and the best variant is
+ * chosen at runtime. */
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__has_attribute)
+# if __has_attribute(target_clones)
+#  define COLORMAP_DISPATCH __attribute__((target_clones("avx512f", "avx2", "default")))
+# endif
+#endif
+#ifndef COLORMAP_DISPATCH
+# define COLORMAP_DISPATCH
+#endif
+
+namespace ColorMap {
+
+ApplyParameters::ApplyParameters(float min_value, float max_value) :
+    min_value(min_value),
+    max_value(max_value),
+    interpolation(InterpolationNearest),
+    channels(3),
+    nan_color { 0, 0, 0, 255 }
+{
+}
+
+static const int block_size = 256;
+
+// Return a block of input values as float.
+static const float* block_values(int, const float* values, float*)
+{
+    return values;
+}
+
+static const float* block_values(int count, const unsigned short* values, float* buf)
+{
+    for (int i = 0; i < count; i++)
+        buf[i] = values[i];
+    return buf;
+}
+
+// Compute the color map positions in [0,last] of the given values. NaN values
+// get position 0; they are handled separately.
+COLORMAP_DISPATCH
+static void values_to_positions(int count, const float* values,
+        float offset, float scale, float last, float* positions)
+{
+    for (int i = 0; i < count; i++) {
+        float p = (values[i] - offset) * scale;
+        p = (p > 0.0f ? p : 0.0f);
+        p = (p < last ? p : last);
+        positions[i] = p;
+    }
+}
+
+template<int channels, Interpolation interpolation>
+static void positions_to_colors(int count, const float* values, const float* positions,
+        int n, const unsigned char* colormap, const unsigned char* nan_color,
+        unsigned char* output)
+{
+    for (int i = 0; i < count; i++) {
+        unsigned char* out = output + channels * i;
+        if (values[i] != values[i]) {
+            for (int c = 0; c < channels; c++)
+                out[c] = nan_color[c];
+            continue;
+        }
+        float p = positions[i];
+        if (interpolation == InterpolationNearest || n == 1) {
+            const unsigned char* color = colormap + 3 * int(p + 0.5f);
+            out[0] = color[0];
+            out[1] = color[1];
+            out[2] = color[2];
+        } else {
+            // 8 bit fixed point weights are exact enough for 8 bit output
+            int j = std::min(int(p), n - 2);
+            int w = (p - j) * 256.0f + 0.5f;
+            const unsigned char* color0 = colormap + 3 * j;
+            const unsigned char* color1 = color0 + 3;
+            out[0] = (color0[0] * (256 - w) + color1[0] * w + 128) >> 8;
+            out[1] = (color0[1] * (256 - w) + color1[1] * w + 128) >> 8;
+            out[2] = (color0[2] * (256 - w) + color1[2] * w + 128) >> 8;
+        }
+        if (channels == 4)
+            out[3] = 255;
+    }
+}
+
+template<typename T> struct apply_job {
+    int n;
+    const unsigned char* colormap;
+    const ApplyParameters* parameters;
+    int width;
+    const T* values;
+    size_t values_stride;
+    unsigned char* output;
+    size_t output_stride;
+};
+
+template<typename T> static void apply_rows(void* data, int begin, int end)
+{
+    const apply_job<T>* j = static_cast<const apply_job<T>*>(data);
+    const ApplyParameters& p = *(j->parameters);
+    float last = j->n - 1;
+    float range = p.max_value - p.min_value;
+    float scale = (range != 0.0f ? last / range : 0.0f);
+    bool linear = (p.interpolation == InterpolationLinear);
+    float buf[block_size];
+    float positions[block_size];
+    for (int y = begin; y < end; y++) {
+        const T* row = j->values + y * j->values_stride;
+        unsigned char* out_row = j->output + y * j->output_stride;
+        for (int x = 0; x < j->width; x += block_size) {
+            int count = std::min(block_size, j->width - x);
+            const float* values = block_values(count, row + x, buf);
+            values_to_positions(count, values, p.min_value, scale, last, positions);
+            unsigned char* out = out_row + p.channels * x;
+            if (p.channels == 3 && !linear)
+                positions_to_colors<3, InterpolationNearest>(count, values, positions, j->n, j->colormap, p.nan_color, out);
+            else if (p.channels == 3)
+                positions_to_colors<3, InterpolationLinear>(count, values, positions, j->n, j->colormap, p.nan_color, out);
+            else if (!linear)
+                positions_to_colors<4, InterpolationNearest>(count, values, positions, j->n, j->colormap, p.nan_color, out);
+            else
+                positions_to_colors<4, InterpolationLinear>(count, values, positions, j->n, j->colormap, p.nan_color, out);
+        }
+    }
+}
+
+template<typename T> static void apply(int n, const unsigned char* srgb_colormap,
+        const ApplyParameters& parameters, int width, int height,
+        const T* values, int values_stride, unsigned char* output, int output_stride)
+{
+    apply_job<T> j;
+    j.n = n;
+    j.colormap = srgb_colormap;
+    j.parameters = &parameters;
+    j.width = width;
+    j.values = values;
+    j.values_stride = (values_stride > 0 ? values_stride : width);
+    j.output = output;
+    j.output_stride = (output_stride > 0 ? output_stride : parameters.channels * width);
+    // process bands of rows with at least 64k pixels
+    int grain = 65536 / std::max(width, 1);
+    ParallelFor(height, grain, apply_rows<T>, &j);
+}
+
+void Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        int width, int height, const float* values, int values_stride,
+        unsigned char* output, int output_stride)
+{
+    apply(n, srgb_colormap, parameters, width, height, values, values_stride, output, output_stride);
+}
+
+/* 16 bit input: for large images, it is faster to first apply the color map
+ * to all 65536 possible values and then look up each pixel in the result. */
+
+struct lut_job {
+    const unsigned char* lut;
+    int width;
+    const unsigned short* values;
+    size_t values_stride;
+    unsigned char* output;
+    size_t output_stride;
+};
+
+template<int channels> static void lut_rows(void* data, int begin, int end)
+{
+    const lut_job* j = static_cast<const lut_job*>(data);
+    for (int y = begin; y < end; y++) {
+        const unsigned short* row = j->values + y * j->values_stride;
+        unsigned char* out = j->output + y * j->output_stride;
+        for (int x = 0; x < j->width; x++) {
+            const unsigned char* color = j->lut + channels * row[x];
+            for (int c = 0; c < channels; c++)
+                out[channels * x + c] = color[c];
+        }
+    }
+}
+
+// All possible 16 bit values, as input for the lookup table
+static const unsigned short* all_values()
+{
+    static const std::vector<unsigned short> values = [] {
+            std::vector<unsigned short> v(ApplyLUTEntries);
+            for (int i = 0; i < ApplyLUTEntries; i++)
+                v[i] = i;
+            return v;
+        }();
+    return values.data();
+}
+
+void BuildApplyLUT(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        unsigned char* lut)
+{
+    apply(n, srgb_colormap, parameters, ApplyLUTEntries, 1, all_values(), 0, lut, 0);
+}
+
+void ApplyLUT(const unsigned char* lut, const ApplyParameters& parameters,
+        int width, int height, const unsigned short* values, int values_stride,
+        unsigned char* output, int output_stride)
+{
+    lut_job j;
+    j.lut = lut;
+    j.width = width;
+    j.values = values;
+    j.values_stride = (values_stride > 0 ? values_stride : width);
+    j.output = output;
+    j.output_stride = (output_stride > 0 ? output_stride : parameters.channels * width);
+    int grain = 65536 / std::max(width, 1);
+    ParallelFor(height, grain, parameters.channels == 3 ? lut_rows<3> : lut_rows<4>, &j);
+}
+
+void Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        int width, int height, const unsigned short* values, int values_stride,
+        unsigned char* output, int output_stride)
+{
+    if (size_t(width) * size_t(height) < 4 * size_t(ApplyLUTEntries)) {
+        apply(n, srgb_colormap, parameters, width, height, values, values_stride, output, output_stride);
+        return;
+    }
+    std::vector<unsigned char> lut(ApplyLUTSize(parameters));
+    BuildApplyLUT(n, srgb_colormap, parameters, lut.data());
+    ApplyLUT(lut.data(), parameters, width, height, values, values_stride, output, output_stride);
+}
+
+}
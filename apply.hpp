@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_APPLY_HPP
+#define COLORMAP_APPLY_HPP
+
+/* Apply color maps to scalar images.
+ *
+ * Each value v of the input image is mapped to the position
+ * t = (v - min_value) / (max_value - min_value) in the color map, clamped to
+ * [0,1], and the output pixel gets the corresponding color. The output is an
+ * image with 3 (RGB) or 4 (RGBA) unsigned char channels per pixel, with the
+ * alpha channel set to 255. NaN input values get the NaN color instead.
+ *
+ * Large images are split into bands of rows that are processed in parallel on
+ * the global thread pool (see SetThreads() in colormap.hpp).
+ */
+
+namespace ColorMap {
+
+enum Interpolation {
+    InterpolationNearest,       // use the nearest color map entry
+    InterpolationLinear         // interpolate linearly between the two nearest entries
+};
+
+struct ApplyParameters {
+    float min_value;            // value mapped to the first color map entry
+    float max_value;            // value mapped to the last color map entry
+    Interpolation interpolation;
+    int channels;               // 3 for RGB output, 4 for RGBA output
+    unsigned char nan_color[4]; // output for NaN values; the first channels entries are used
+
+    // Construct parameters for nearest-neighbor RGB output with black for NaN.
+    ApplyParameters(float min_value = 0.0f, float max_value = 1.0f);
+};
+
+// Apply the color map with n sRGB triplets to the input image with the given
+// width and height. The strides give the number of elements from one row to
+// the next in the input values and the output; 0 means that the rows are
+// tightly packed.
+
+void Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        int width, int height, const float* values, int values_stride,
+        unsigned char* output, int output_stride = 0);
+
+void Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        int width, int height, const unsigned short* values, int values_stride,
+        unsigned char* output, int output_stride = 0);
+
+// For 16 bit input, the color map can also be applied via a lookup table
+// with the output for all 65536 possible values; for large images, Apply()
+// does this internally. The table needs room for ApplyLUTSize(parameters)
+// bytes and can be reused for all images with the same color map and
+// parameters. ApplyLUT() gives the same result as Apply().
+
+const int ApplyLUTEntries = 65536;
+
+inline int ApplyLUTSize(const ApplyParameters& parameters)
+{
+    return parameters.channels * ApplyLUTEntries;
+}
+
+void BuildApplyLUT(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        unsigned char* lut);
+
+void ApplyLUT(const unsigned char* lut, const ApplyParameters& parameters,
+        int width, int height, const unsigned short* values, int values_stride,
+        unsigned char* output, int output_stride = 0);
+
+}
+
+#endif
@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <vector>
+#include <cstring>
+
+#include <GL/glcorearb.h>
+
+#include "apply_gl.hpp"
+
+namespace ColorMap {
+
+/* The compute shader. It computes color map positions like apply.cpp, and
+ * interpolates 8 bit colors with the same fixed point arithmetic. */
+static const char* shader_source = R"(
+layout(local_size_x = 16, local_size_y = 16) in;
+#if BITS16
+layout(r16ui, binding = 0) uniform readonly uimage2D values;
+#else
+layout(r32f, binding = 0) uniform readonly image2D values;
+#endif
+layout(rgba8, binding = 1) uniform writeonly image2D colors;
+#if FLOAT_LUT
+layout(binding = 0) uniform sampler1D colormap;
+#else
+layout(binding = 0) uniform usampler1D colormap;
+#endif
+uniform ivec2 size;
+uniform int n;
+uniform float offset;
+uniform float scale;
+uniform float last;
+uniform bool linear;
+uniform vec4 nan_color;
+
+vec3 entry(int i)
+{
+    return vec3(texelFetch(colormap, i, 0).rgb);
+}
+
+void main()
+{
+    ivec2 xy = ivec2(gl_GlobalInvocationID.xy);
+    if (xy.x >= size.x || xy.y >= size.y)
+        return;
+    float v = float(imageLoad(values, xy).r);
+    vec4 color = nan_color;
+    if (!isnan(v)) {
+        float p = clamp((v - offset) * scale, 0.0, last);
+        vec3 rgb;
+        if (!linear || n == 1) {
+            rgb = entry(int(p + 0.5));
+        } else {
+            int j = min(int(p), n - 2);
+#if FLOAT_LUT
+            rgb = mix(entry(j), entry(j + 1), p - float(j));
+#else
+            int w = int((p - float(j)) * 256.0 + 0.5);
+            rgb = vec3((ivec3(entry(j)) * (256 - w) + ivec3(entry(j + 1)) * w + 128) >> 8);
+#endif
+        }
+#if FLOAT_LUT
+        color = vec4(rgb, 1.0);
+#else
+        color = vec4(rgb / 255.0, 1.0);
+#endif
+    }
+    imageStore(colors, xy, color);
+}
+)";
+
+struct gl_state {
+    PFNGLGETERRORPROC GetError;
+    PFNGLGETINTEGERVPROC GetIntegerv;
+    PFNGLCREATESHADERPROC CreateShader;
+    PFNGLSHADERSOURCEPROC ShaderSource;
+    PFNGLCOMPILESHADERPROC CompileShader;
+    PFNGLGETSHADERIVPROC GetShaderiv;
+    PFNGLDELETESHADERPROC DeleteShader;
+    PFNGLCREATEPROGRAMPROC CreateProgram;
+    PFNGLATTACHSHADERPROC AttachShader;
+    PFNGLLINKPROGRAMPROC LinkProgram;
+    PFNGLGETPROGRAMIVPROC GetProgramiv;
+    PFNGLDELETEPROGRAMPROC DeleteProgram;
+    PFNGLUSEPROGRAMPROC UseProgram;
+    PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+    PFNGLUNIFORM1IPROC Uniform1i;
+    PFNGLUNIFORM2IPROC Uniform2i;
+    PFNGLUNIFORM1FPROC Uniform1f;
+    PFNGLUNIFORM4FPROC Uniform4f;
+    PFNGLGENTEXTURESPROC GenTextures;
+    PFNGLDELETETEXTURESPROC DeleteTextures;
+    PFNGLBINDTEXTUREPROC BindTexture;
+    PFNGLACTIVETEXTUREPROC ActiveTexture;
+    PFNGLTEXPARAMETERIPROC TexParameteri;
+    PFNGLTEXIMAGE1DPROC TexImage1D;
+    PFNGLTEXIMAGE2DPROC TexImage2D;
+    PFNGLTEXSUBIMAGE2DPROC TexSubImage2D;
+    PFNGLGETTEXIMAGEPROC GetTexImage;
+    PFNGLPIXELSTOREIPROC PixelStorei;
+    PFNGLBINDIMAGETEXTUREPROC BindImageTexture;
+    PFNGLDISPATCHCOMPUTEPROC DispatchCompute;
+    PFNGLMEMORYBARRIERPROC MemoryBarrier;
+
+    GLuint programs[2][2];      // indexed by bits16 and float_lut
+    GLuint lut;                 // 1D texture with the color map
+    int n;
+    bool float_lut;
+    // textures for Apply(), reused while the image size stays the same
+    GLuint values[2];           // indexed by bits16
+    GLuint output;
+    int width, height;
+    std::vector<unsigned char> readback;
+};
+
+template<typename F> static bool load(GLGetProcAddress get_proc_address, const char* name, F& f)
+{
+    f = reinterpret_cast<F>(get_proc_address(name));
+    return f;
+}
+
+static GLuint compile_program(const gl_state* gl, bool bits16, bool float_lut);
+
+// Create a 2D texture without mipmaps
+static GLuint create_texture_2d(const gl_state* gl, GLint internal_format,
+        GLenum format, GLenum type, int width, int height)
+{
+    GLuint tex;
+    gl->GenTextures(1, &tex);
+    gl->BindTexture(GL_TEXTURE_2D, tex);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl->TexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+    return tex;
+}
+
+GLApplier::GLApplier() : _gl(NULL)
+{
+}
+
+GLApplier::~GLApplier()
+{
+    delete _gl;
+}
+
+bool GLApplier::Initialize(GLGetProcAddress get_proc_address)
+{
+    Release();
+    gl_state* gl = new gl_state;
+    memset(gl->programs, 0, sizeof(gl->programs));
+    gl->lut = 0;
+    gl->n = 0;
+    gl->float_lut = false;
+    gl->values[0] = gl->values[1] = 0;
+    gl->output = 0;
+    gl->width = gl->height = 0;
+    bool ok = load(get_proc_address, "glGetError", gl->GetError)
+        && load(get_proc_address, "glGetIntegerv", gl->GetIntegerv)
+        && load(get_proc_address, "glCreateShader", gl->CreateShader)
+        && load(get_proc_address, "glShaderSource", gl->ShaderSource)
+        && load(get_proc_address, "glCompileShader", gl->CompileShader)
+        && load(get_proc_address, "glGetShaderiv", gl->GetShaderiv)
+        && load(get_proc_address, "glDeleteShader", gl->DeleteShader)
+        && load(get_proc_address, "glCreateProgram", gl->CreateProgram)
+        && load(get_proc_address, "glAttachShader", gl->AttachShader)
+        && load(get_proc_address, "glLinkProgram", gl->LinkProgram)
+        && load(get_proc_address, "glGetProgramiv", gl->GetProgramiv)
+        && load(get_proc_address, "glDeleteProgram", gl->DeleteProgram)
+        && load(get_proc_address, "glUseProgram", gl->UseProgram)
+        && load(get_proc_address, "glGetUniformLocation", gl->GetUniformLocation)
+        && load(get_proc_address, "glUniform1i", gl->Uniform1i)
+        && load(get_proc_address, "glUniform2i", gl->Uniform2i)
+        && load(get_proc_address, "glUniform1f", gl->Uniform1f)
+        && load(get_proc_address, "glUniform4f", gl->Uniform4f)
+        && load(get_proc_address, "glGenTextures", gl->GenTextures)
+        && load(get_proc_address, "glDeleteTextures", gl->DeleteTextures)
+        && load(get_proc_address, "glBindTexture", gl->BindTexture)
+        && load(get_proc_address, "glActiveTexture", gl->ActiveTexture)
+        && load(get_proc_address, "glTexParameteri", gl->TexParameteri)
+        && load(get_proc_address, "glTexImage1D", gl->TexImage1D)
+        && load(get_proc_address, "glTexImage2D", gl->TexImage2D)
+        && load(get_proc_address, "glTexSubImage2D", gl->TexSubImage2D)
+        && load(get_proc_address, "glGetTexImage", gl->GetTexImage)
+        && load(get_proc_address, "glPixelStorei", gl->PixelStorei)
+        && load(get_proc_address, "glBindImageTexture", gl->BindImageTexture)
+        && load(get_proc_address, "glDispatchCompute", gl->DispatchCompute)
+        && load(get_proc_address, "glMemoryBarrier", gl->MemoryBarrier);
+    if (!ok) {
+        delete gl;
+        return false;
+    }
+    _gl = gl;
+    for (int b = 0; b < 2; b++) {
+        for (int f = 0; f < 2; f++) {
+            gl->programs[b][f] = compile_program(gl, b, f);
+            if (!gl->programs[b][f]) {
+                Release();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static GLuint compile_program(const gl_state* gl, bool bits16, bool float_lut)
+{
+    const char* sources[4] = {
+        "#version 430\n",
+        bits16 ? "#define BITS16 1\n" : "#define BITS16 0\n",
+        float_lut ? "#define FLOAT_LUT 1\n" : "#define FLOAT_LUT 0\n",
+        shader_source
+    };
+    GLuint shader = gl->CreateShader(GL_COMPUTE_SHADER);
+    if (!shader)
+        return 0;
+    gl->ShaderSource(shader, 4, sources, NULL);
+    gl->CompileShader(shader);
+    GLint status;
+    gl->GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (status != GL_TRUE) {
+        gl->DeleteShader(shader);
+        return 0;
+    }
+    GLuint program = gl->CreateProgram();
+    gl->AttachShader(program, shader);
+    gl->LinkProgram(program);
+    gl->DeleteShader(shader); // the program keeps it as long as it needs it
+    gl->GetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        gl->DeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void GLApplier::Release()
+{
+    if (!_gl)
+        return;
+    for (int b = 0; b < 2; b++)
+        for (int f = 0; f < 2; f++)
+            if (_gl->programs[b][f])
+                _gl->DeleteProgram(_gl->programs[b][f]);
+    GLuint textures[4] = { _gl->lut, _gl->values[0], _gl->values[1], _gl->output };
+    for (int i = 0; i < 4; i++)
+        if (textures[i])
+            _gl->DeleteTextures(1, &textures[i]);
+    delete _gl;
+    _gl = NULL;
+}
+
+static bool upload(gl_state* gl, int n, GLint internal_format, GLenum format, GLenum type,
+        const void* data)
+{
+    GLint max_size;
+    gl->GetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (n < 1 || n > max_size)
+        return false;
+    if (!gl->lut)
+        gl->GenTextures(1, &gl->lut);
+    gl->BindTexture(GL_TEXTURE_1D, gl->lut);
+    gl->TexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    gl->TexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    gl->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl->TexImage1D(GL_TEXTURE_1D, 0, internal_format, n, 0, format, type, data);
+    gl->n = n;
+    return gl->GetError() == GL_NO_ERROR;
+}
+
+bool GLApplier::Upload(int n, const unsigned char* srgb_colormap)
+{
+    if (!_gl)
+        return false;
+    _gl->float_lut = false;
+    return upload(_gl, n, GL_RGB8UI, GL_RGB_INTEGER, GL_UNSIGNED_BYTE, srgb_colormap);
+}
+
+bool GLApplier::Upload(int n, const float* srgb_colormap)
+{
+    if (!_gl)
+        return false;
+    _gl->float_lut = true;
+    return upload(_gl, n, GL_RGB32F, GL_RGB, GL_FLOAT, srgb_colormap);
+}
+
+bool GLApplier::ApplyTextures(const ApplyParameters& parameters, int width, int height,
+        unsigned int values_texture, bool bits16, unsigned int output_texture)
+{
+    if (!_gl || !_gl->lut)
+        return false;
+    const ApplyParameters& p = parameters;
+    float last = _gl->n - 1;
+    float range = p.max_value - p.min_value;
+    float scale = (range != 0.0f ? last / range : 0.0f);
+    GLuint program = _gl->programs[bits16][_gl->float_lut];
+    _gl->UseProgram(program);
+    _gl->Uniform2i(_gl->GetUniformLocation(program, "size"), width, height);
+    _gl->Uniform1i(_gl->GetUniformLocation(program, "n"), _gl->n);
+    _gl->Uniform1f(_gl->GetUniformLocation(program, "offset"), p.min_value);
+    _gl->Uniform1f(_gl->GetUniformLocation(program, "scale"), scale);
+    _gl->Uniform1f(_gl->GetUniformLocation(program, "last"), last);
+    _gl->Uniform1i(_gl->GetUniformLocation(program, "linear"), p.interpolation == InterpolationLinear);
+    _gl->Uniform4f(_gl->GetUniformLocation(program, "nan_color"),
+            p.nan_color[0] / 255.0f, p.nan_color[1] / 255.0f, p.nan_color[2] / 255.0f, p.nan_color[3] / 255.0f);
+    _gl->ActiveTexture(GL_TEXTURE0);
+    _gl->BindTexture(GL_TEXTURE_1D, _gl->lut);
+    _gl->BindImageTexture(0, values_texture, 0, GL_FALSE, 0, GL_READ_ONLY, bits16 ? GL_R16UI : GL_R32F);
+    _gl->BindImageTexture(1, output_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    _gl->DispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+    _gl->MemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+            | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    _gl->UseProgram(0);
+    return _gl->GetError() == GL_NO_ERROR;
+}
+
+static bool apply(GLApplier& applier, gl_state* gl, const ApplyParameters& parameters,
+        int width, int height, const void* values, int values_stride, bool bits16,
+        unsigned char* output, int output_stride)
+{
+    if (width != gl->width || height != gl->height) {
+        GLuint textures[3] = { gl->values[0], gl->values[1], gl->output };
+        for (int i = 0; i < 3; i++)
+            if (textures[i])
+                gl->DeleteTextures(1, &textures[i]);
+        gl->values[0] = gl->values[1] = gl->output = 0;
+        gl->width = width;
+        gl->height = height;
+    }
+    GLuint& values_texture = gl->values[bits16];
+    if (!values_texture) {
+        values_texture = bits16
+            ? create_texture_2d(gl, GL_R16UI, GL_RED_INTEGER, GL_UNSIGNED_SHORT, width, height)
+            : create_texture_2d(gl, GL_R32F, GL_RED, GL_FLOAT, width, height);
+    }
+    if (!gl->output)
+        gl->output = create_texture_2d(gl, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+
+    gl->BindTexture(GL_TEXTURE_2D, values_texture);
+    gl->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, values_stride > 0 ? values_stride : 0);
+    gl->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+            bits16 ? GL_RED_INTEGER : GL_RED, bits16 ? GL_UNSIGNED_SHORT : GL_FLOAT, values);
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (!applier.ApplyTextures(parameters, width, height, values_texture, bits16, gl->output))
+        return false;
+
+    // Read back the result and copy it row by row to respect the output stride
+    int channels = parameters.channels;
+    size_t row_size = size_t(channels) * width;
+    gl->readback.resize(row_size * height);
+    gl->BindTexture(GL_TEXTURE_2D, gl->output);
+    gl->PixelStorei(GL_PACK_ALIGNMENT, 1);
+    gl->PixelStorei(GL_PACK_ROW_LENGTH, 0);
+    gl->GetTexImage(GL_TEXTURE_2D, 0, channels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, gl->readback.data());
+    if (gl->GetError() != GL_NO_ERROR)
+        return false;
+    size_t stride = (output_stride > 0 ? output_stride : row_size);
+    for (int y = 0; y < height; y++)
+        memcpy(output + y * stride, gl->readback.data() + y * row_size, row_size);
+    return true;
+}
+
+bool GLApplier::Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        int width, int height, const float* values, int values_stride,
+        unsigned char* output, int output_stride)
+{
+    return Upload(n, srgb_colormap)
+        && apply(*this, _gl, parameters, width, height, values, values_stride, false, output, output_stride);
+}
+
+bool GLApplier::Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        int width, int height, const unsigned short* values, int values_stride,
+        unsigned char* output, int output_stride)
+{
+    return Upload(n, srgb_colormap)
+        && apply(*this, _gl, parameters, width, height, values, values_stride, true, output, output_stride);
+}
+
+}
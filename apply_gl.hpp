@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_APPLY_GL_HPP
+#define COLORMAP_APPLY_GL_HPP
+
+#include "apply.hpp"
+
+/* Apply color maps to scalar images on the GPU.
+ *
+ * A GLApplier does the same as Apply() in apply.hpp with OpenGL 4.3 compute
+ * shaders. The color map is uploaded once as a 1D texture, either with 8 bit
+ * sRGB values or with float sRGB values as computed by Generate(). It can then
+ * be applied to any number of images:
+ * - ApplyTextures() maps a GL_R32F or GL_R16UI texture to a GL_RGBA8 texture
+ *   without any transfer between host and device.
+ * - Apply() has the same interface as the CPU version and transfers the
+ *   input and output images.
+ * With an 8 bit color map, the results are the same as with the CPU version,
+ * except that a value whose color map position lies exactly between two
+ * entries may be rounded differently.
+ *
+ * All functions must be called with the same OpenGL context current. They
+ * return false if an OpenGL operation failed, e.g. because the context does
+ * not support compute shaders; use the CPU version then.
+ *
+ * This module is only part of the library if it was built with the CMake
+ * option GENCOLORMAP_GL.
+ */
+
+namespace ColorMap {
+
+// A function that returns the address of an OpenGL function, e.g.
+// glXGetProcAddress() or a wrapper around QOpenGLContext::getProcAddress()
+typedef void* (*GLGetProcAddress)(const char* name);
+
+struct gl_state;
+
+class GLApplier {
+private:
+    gl_state* _gl;
+
+public:
+    GLApplier();
+    // The destructor does not touch the OpenGL context; call Release() first.
+    ~GLApplier();
+
+    GLApplier(const GLApplier&) = delete;
+    GLApplier& operator=(const GLApplier&) = delete;
+
+    // Load the OpenGL functions and compile the shaders.
+    bool Initialize(GLGetProcAddress get_proc_address);
+
+    // Delete all OpenGL objects.
+    void Release();
+
+    // Upload a color map with n sRGB triplets. It is used by all following
+    // calls of ApplyTextures() and Apply().
+    bool Upload(int n, const unsigned char* srgb_colormap);
+    bool Upload(int n, const float* srgb_colormap);
+
+    // Apply the uploaded color map to a values texture with the given size,
+    // with internal format GL_R32F or GL_R16UI (bits16), and write the result
+    // to the output texture with internal format GL_RGBA8 and the same size.
+    // The channels field of the parameters is ignored; the alpha channel is
+    // set to 1 except for NaN values.
+    bool ApplyTextures(const ApplyParameters& parameters, int width, int height,
+            unsigned int values_texture, bool bits16, unsigned int output_texture);
+
+    // Upload the color map and apply it like Apply() in apply.hpp.
+    bool Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+            int width, int height, const float* values, int values_stride,
+            unsigned char* output, int output_stride = 0);
+    bool Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+            int width, int height, const unsigned short* values, int values_stride,
+            unsigned char* output, int output_stride = 0);
+};
+
+}
+
+#endif
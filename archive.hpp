@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_ARCHIVE_HPP
+#define COLORMAP_ARCHIVE_HPP
+
+/* Color map archives.
+ *
+ * An archive stores many color maps in one file, so that an application can
+ * map the file into memory and use the color maps without copying or parsing.
+ * Archives are written by WriteArchive() (see export.hpp) and by the
+ * gencolormap tool with the --archive option, and read with the header-only
+ * ArchiveReader class below.
+ *
+ * File layout (all values little endian):
+ * - ArchiveHeader (64 bytes)
+ * - count ArchiveEntry records (40 bytes each)
+ * - a hash table for names: table_size 32 bit slots
+ * - a hash table for parameter hashes: table_size 32 bit slots
+ * - the names, each terminated by a null byte
+ * - for each color map, aligned to 64 bytes: n 8 bit sRGB triplets, and
+ *   n 32 bit float sRGB triplets with values in [0,1]
+ *
+ * The hash tables use linear probing from slot (hash & (table_size - 1)), and
+ * table_size is a power of two. Empty slots contain 0, other slots contain the
+ * entry index plus one. Names are hashed with ArchiveNameHash(), parameters
+ * with ColorMap::Hash().
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# define COLORMAP_ARCHIVE_MMAP 1
+#endif
+
+namespace ColorMap {
+
+const uint32_t ArchiveVersion = 1;
+const uint32_t ArchiveByteOrder = 0x01020304;
+const char ArchiveMagic[8] = { 'G', 'C', 'M', 'L', 'I', 'B', 0, 0 };
+
+struct ArchiveHeader {
+    char magic[8];              // ArchiveMagic
+    uint32_t byte_order;        // ArchiveByteOrder
+    uint32_t version;           // ArchiveVersion
+    uint32_t count;             // number of color maps
+    uint32_t table_size;        // number of slots in each hash table
+    uint64_t entries_offset;
+    uint64_t name_table_offset;
+    uint64_t hash_table_offset;
+    uint64_t names_offset;
+    uint64_t file_size;
+};
+
+struct ArchiveEntry {
+    uint64_t parameter_hash;    // ColorMap::Hash() of the parameters
+    uint32_t name_offset;       // relative to names_offset
+    uint32_t name_length;       // without the terminating null byte
+    uint32_t n;                 // number of colors
+    uint32_t reserved;
+    uint64_t srgb_offset;       // 3 * n unsigned char values
+    uint64_t srgb_float_offset; // 3 * n float values
+};
+
+static_assert(sizeof(ArchiveHeader) == 64, "unexpected archive header size");
+static_assert(sizeof(ArchiveEntry) == 40, "unexpected archive entry size");
+
+// 64 bit FNV-1a hash of a name
+inline uint64_t ArchiveNameHash(const char* name, size_t length)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        h ^= static_cast<unsigned char>(name[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* Read-only access to an archive. The file is mapped into memory where
+ * possible and read into memory otherwise. All returned pointers remain valid
+ * until the reader is closed or destroyed. The file is checked for consistency
+ * when it is opened, so that invalid files cannot lead to invalid pointers. */
+
+class ArchiveReader {
+private:
+    const unsigned char* _data;
+    size_t _size;
+    bool _mapped;
+    std::vector<unsigned char> _buffer;
+
+    const ArchiveHeader* header() const
+    {
+        return reinterpret_cast<const ArchiveHeader*>(_data);
+    }
+
+    const ArchiveEntry* entry(int index) const
+    {
+        return reinterpret_cast<const ArchiveEntry*>(_data + header()->entries_offset) + index;
+    }
+
+    const uint32_t* table(uint64_t offset) const
+    {
+        return reinterpret_cast<const uint32_t*>(_data + offset);
+    }
+
+    bool range_ok(uint64_t offset, uint64_t size, uint64_t alignment) const
+    {
+        return offset % alignment == 0 && offset <= _size && size <= _size - offset;
+    }
+
+    bool check() const
+    {
+        if (_size < sizeof(ArchiveHeader))
+            return false;
+        const ArchiveHeader* h = header();
+        if (std::memcmp(h->magic, ArchiveMagic, sizeof(ArchiveMagic)) != 0
+                || h->byte_order != ArchiveByteOrder
+                || h->version != ArchiveVersion
+                || h->file_size != _size
+                || h->table_size == 0 || (h->table_size & (h->table_size - 1)) != 0
+                || h->count >= h->table_size
+                || !range_ok(h->entries_offset, uint64_t(h->count) * sizeof(ArchiveEntry), 8)
+                || !range_ok(h->name_table_offset, uint64_t(h->table_size) * 4, 4)
+                || !range_ok(h->hash_table_offset, uint64_t(h->table_size) * 4, 4)
+                || !range_ok(h->names_offset, 0, 1))
+            return false;
+        // each table must have exactly count used slots, so that probing ends
+        uint32_t used_names = 0, used_hashes = 0;
+        for (uint32_t i = 0; i < h->table_size; i++) {
+            uint32_t n = table(h->name_table_offset)[i];
+            uint32_t p = table(h->hash_table_offset)[i];
+            if (n > h->count || p > h->count)
+                return false;
+            used_names += (n != 0);
+            used_hashes += (p != 0);
+        }
+        if (used_names != h->count || used_hashes != h->count)
+            return false;
+        for (uint32_t i = 0; i < h->count; i++) {
+            const ArchiveEntry* e = entry(i);
+            if (!range_ok(h->names_offset + e->name_offset, uint64_t(e->name_length) + 1, 1)
+                    || _data[h->names_offset + e->name_offset + e->name_length] != 0
+                    || !range_ok(e->srgb_offset, 3 * uint64_t(e->n), 1)
+                    || !range_ok(e->srgb_float_offset, 3 * uint64_t(e->n) * sizeof(float), 4))
+                return false;
+        }
+        return true;
+    }
+
+public:
+    // A color map in the archive
+    struct Map {
+        const char* name;
+        uint64_t parameter_hash;
+        int n;
+        const unsigned char* srgb;  // n sRGB triplets
+        const float* srgb_float;    // n sRGB triplets with values in [0,1]
+    };
+
+    ArchiveReader() : _data(NULL), _size(0), _mapped(false)
+    {
+    }
+
+    ArchiveReader(const ArchiveReader&) = delete;
+    ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+    ~ArchiveReader()
+    {
+        close();
+    }
+
+    // Open an archive file. Returns false if the file cannot be read or is
+    // not a valid archive for this platform.
+    bool open(const char* filename)
+    {
+        close();
+#ifdef COLORMAP_ARCHIVE_MMAP
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                _data = static_cast<const unsigned char*>(p);
+                _size = st.st_size;
+                _mapped = true;
+            }
+        }
+        ::close(fd);
+#endif
+        if (!_data) {
+            FILE* f = std::fopen(filename, "rb");
+            if (!f)
+                return false;
+            unsigned char chunk[65536];
+            size_t r;
+            while ((r = std::fread(chunk, 1, sizeof(chunk), f)) > 0)
+                _buffer.insert(_buffer.end(), chunk, chunk + r);
+            bool ok = !std::ferror(f);
+            std::fclose(f);
+            if (!ok || _buffer.empty()) {
+                _buffer.clear();
+                return false;
+            }
+            _data = _buffer.data();
+            _size = _buffer.size();
+        }
+        if (!check()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef COLORMAP_ARCHIVE_MMAP
+        if (_mapped)
+            munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+        _buffer.clear();
+        _data = NULL;
+        _size = 0;
+        _mapped = false;
+    }
+
+    // Number of color maps in the archive
+    int count() const
+    {
+        return _data ? header()->count : 0;
+    }
+
+    // Get the color map with the given index in [0,count())
+    Map map(int index) const
+    {
+        const ArchiveEntry* e = entry(index);
+        Map m;
+        m.name = reinterpret_cast<const char*>(_data + header()->names_offset + e->name_offset);
+        m.parameter_hash = e->parameter_hash;
+        m.n = e->n;
+        m.srgb = _data + e->srgb_offset;
+        m.srgb_float = reinterpret_cast<const float*>(_data + e->srgb_float_offset);
+        return m;
+    }
+
+    // Find the index of the color map with the given name; -1 if there is none
+    int find(const char* name) const
+    {
+        if (!_data)
+            return -1;
+        const ArchiveHeader* h = header();
+        size_t length = std::strlen(name);
+        const uint32_t* slots = table(h->name_table_offset);
+        uint32_t mask = h->table_size - 1;
+        for (uint32_t i = ArchiveNameHash(name, length) & mask; slots[i] != 0; i = (i + 1) & mask) {
+            const ArchiveEntry* e = entry(slots[i] - 1);
+            if (e->name_length == length
+                    && std::memcmp(_data + h->names_offset + e->name_offset, name, length) == 0)
+                return slots[i] - 1;
+        }
+        return -1;
+    }
+
+    // Find the index of a color map with the given parameter hash; -1 if there is none
+    int find(uint64_t parameter_hash) const
+    {
+        if (!_data)
+            return -1;
+        const ArchiveHeader* h = header();
+        const uint32_t* slots = table(h->hash_table_offset);
+        uint32_t mask = h->table_size - 1;
+        for (uint32_t i = parameter_hash & mask; slots[i] != 0; i = (i + 1) & mask) {
+            if (entry(slots[i] - 1)->parameter_hash == parameter_hash)
+                return slots[i] - 1;
+        }
+        return -1;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,671 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Benchmark for the generators and exporters.
+ *
+ * Each case runs repeatedly until a minimum time has passed, for a range of
+ * color map sizes. For each case, the time per color map entry, the number of
+ * heap allocations and allocated bytes per call, and the peak resident set
+ * size are reported as CSV or JSON, so that results can be compared between
+ * versions. Given the CSV results of an earlier run as a baseline, the
+ * benchmark fails if a case became slower than the tolerance allows.
+ *
+ * With --check, the benchmark instead cross-checks the fast paths of the
+ * library (vectorized conversion, fast sRGB quantization, threads, caches,
+ * cursors, lookup tables) against their reference implementations for
+ * randomized parameters, checks that a warmed up context generates without
+ * heap allocations, and fails if any result differs. */
+
+#include <vector>
+#include <string>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <getopt.h>
+extern char *optarg;
+extern int optind;
+
+#include <sys/resource.h>
+
+#include "colormap.hpp"
+#include "export.hpp"
+#include "apply.hpp"
+#include "context.hpp"
+#include "definition.hpp"
+
+
+/* Count heap allocations by replacing the global allocation functions */
+
+static std::atomic<unsigned long long> allocations(0);
+static std::atomic<unsigned long long> allocated_bytes(0);
+
+void* operator new(size_t size)
+{
+    allocations++;
+    allocated_bytes += size;
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+/* Peak resident set size in KiB. On Linux, the peak can be reset so that it
+ * can be measured for each case; elsewhere it is the peak of the whole run. */
+
+static void reset_peak_rss()
+{
+    FILE* f = std::fopen("/proc/self/clear_refs", "w");
+    if (f) {
+        std::fputs("5", f);
+        std::fclose(f);
+    }
+}
+
+static long peak_rss()
+{
+    FILE* f = std::fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kib = -1;
+        while (std::fgets(line, sizeof(line), f)) {
+            if (std::strncmp(line, "VmHWM:", 6) == 0)
+                kib = std::atol(line + 6);
+        }
+        std::fclose(f);
+        if (kib >= 0)
+            return kib;
+    }
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+/* The benchmark cases */
+
+static const char* format_names[] = {
+    "csv",
+    "json",
+    "ppm",
+    "ppm-binary",
+    "raw-rgb8",
+    "raw-rgb32f",
+    "cmap",
+    "png"
+};
+
+// A writer that only counts the bytes
+class null_writer : public ColorMap::Writer {
+public:
+    size_t bytes;
+    null_writer() : bytes(0) {}
+    bool write(const void*, size_t size) override
+    {
+        bytes += size;
+        return true;
+    }
+};
+
+class bench_case {
+public:
+    std::string kind;   // "generate" or "export"
+    std::string name;
+    int type;           // color map type for generators
+    int format;         // export format, or -1..-3 for ToCSV/ToJSON/ToPPM, -4 for WriteArchive
+};
+
+static void run_case(const bench_case& c, int n, unsigned char* colormap, const ColorMap::Parameters& p)
+{
+    if (c.kind == "generate") {
+        ColorMap::Generate(p, colormap);
+    } else if (c.format >= 0) {
+        null_writer w;
+        ColorMap::Export(static_cast<ColorMap::Format>(c.format), n, colormap, w);
+    } else if (c.format == -1) {
+        ColorMap::ToCSV(n, colormap);
+    } else if (c.format == -2) {
+        ColorMap::ToJSON(n, colormap);
+    } else if (c.format == -3) {
+        ColorMap::ToPPM(n, colormap);
+    } else {
+        null_writer w;
+        const char* name = "bench";
+        ColorMap::WriteArchive(1, &name, &p, colormap, w);
+    }
+}
+
+class result {
+public:
+    long long reps;
+    double ns_per_entry;
+    double allocations_per_call;
+    double bytes_per_call;
+    long peak_rss_kib;
+};
+
+static result measure(const bench_case& c, int n, double min_seconds)
+{
+    ColorMap::Parameters p(static_cast<ColorMap::Type>(c.kind == "generate" ? c.type : ColorMap::TypeBrewerSequential), n);
+    std::vector<unsigned char> colormap(3 * size_t(n));
+    if (c.kind != "generate")
+        ColorMap::Generate(p, colormap.data());
+
+    // warm up, so that one-time initializations are not measured
+    run_case(c, n, colormap.data(), p);
+
+    result r;
+    reset_peak_rss();
+    unsigned long long a0 = allocations;
+    unsigned long long b0 = allocated_bytes;
+    auto t0 = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    r.reps = 0;
+    do {
+        run_case(c, n, colormap.data(), p);
+        r.reps++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    } while (elapsed < min_seconds);
+    r.ns_per_entry = elapsed * 1e9 / (double(r.reps) * n);
+    r.allocations_per_call = double(allocations - a0) / r.reps;
+    r.bytes_per_call = double(allocated_bytes - b0) / r.reps;
+    r.peak_rss_kib = peak_rss();
+    return r;
+}
+
+/* Cross-checks of the fast paths against their references */
+
+class checker {
+public:
+    std::mt19937 rng;
+    long long comparisons;
+    long long failures;
+
+    checker(unsigned int seed) : rng(seed), comparisons(0), failures(0)
+    {
+    }
+
+    float uniform(float lo, float hi)
+    {
+        return std::uniform_real_distribution<float>(lo, hi)(rng);
+    }
+
+    int uniform_int(int lo, int hi)
+    {
+        return std::uniform_int_distribution<int>(lo, hi)(rng);
+    }
+
+    // Count a comparison, and report the color map if it failed
+    void expect(bool ok, const std::string& what, const ColorMap::Parameters& p)
+    {
+        comparisons++;
+        if (!ok) {
+            failures++;
+            fprintf(stderr, "check failed: %s for %s", what.c_str(), ColorMap::ToDefinition(p).c_str());
+        }
+    }
+};
+
+// Random parameters for the given type, in the documented ranges, or now and
+// then the defaults of the type. The hue lists are stored in the vectors.
+static ColorMap::Parameters random_parameters(checker& c, ColorMap::Type type,
+        std::vector<float>& hue_values, std::vector<float>& hue_positions)
+{
+    static const int sizes[] = { 1, 2, 3, 5, 7, 9, 11, 255, 256, 257, 1023, 4097 };
+    int n = (c.uniform_int(0, 3) == 0 ? c.uniform_int(2, 100000)
+            : sizes[c.uniform_int(0, sizeof(sizes) / sizeof(sizes[0]) - 1)]);
+    if (type == ColorMap::TypeDistinct)
+        n = std::min(n, 4097); // farthest point sampling is much slower per color
+    ColorMap::Parameters p(type, n);
+    if (c.uniform_int(0, 4) == 0)
+        return p;
+    const float twopi = 6.28318531f;
+    p.hue = c.uniform(0.0f, twopi);
+    p.divergence = c.uniform(0.0f, twopi);
+    p.contrast = c.uniform(0.0f, 1.0f);
+    p.saturation = c.uniform(0.0f, 1.0f);
+    p.saturation_range = c.uniform(0.7f, 1.0f);
+    p.brightness = c.uniform(0.0f, 1.0f);
+    p.warmth = c.uniform(0.0f, 1.0f);
+    p.lightness = c.uniform(0.0f, 1.0f);
+    p.lightness_range = c.uniform(0.7f, 1.0f);
+    p.rotations = c.uniform(-3.0f, 3.0f);
+    p.temperature = c.uniform(250.0f, 10000.0f);
+    p.temperature_range = c.uniform(1000.0f, 30000.0f);
+    p.gamma = c.uniform(0.3f, 3.0f);
+    p.periods = c.uniform(0.5f, 5.0f);
+    for (int i = 0; i < 3; i++) {
+        p.color0[i] = c.uniform_int(0, 255);
+        p.color1[i] = c.uniform_int(0, 255);
+    }
+    if (type == ColorMap::TypePUSequentialMultiHue) {
+        int hues = c.uniform_int(2, 6);
+        hue_values.resize(hues);
+        hue_positions.resize(hues);
+        for (int i = 0; i < hues; i++) {
+            hue_values[i] = c.uniform(0.0f, twopi);
+            hue_positions[i] = (i == 0 ? 0.0f : i == hues - 1 ? 1.0f : c.uniform(0.0f, 1.0f));
+        }
+        std::sort(hue_positions.begin(), hue_positions.end());
+        p.hues = hues;
+        p.hue_values = hue_values.data();
+        p.hue_positions = hue_positions.data();
+    }
+    return p;
+}
+
+template<typename T>
+static std::vector<T> generate(const ColorMap::Parameters& p, int* clipped)
+{
+    std::vector<T> colormap(3 * size_t(p.n));
+    *clipped = ColorMap::Generate(p, colormap.data());
+    return colormap;
+}
+
+template<typename T>
+static bool same(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+// Compare the generated colors with the per-color reference, for each
+// combination of the vectorized conversion, the fast sRGB quantization for 8
+// bit output, and threads
+template<typename T>
+static void check_generate(checker& c, const ColorMap::Parameters& p, const char* component)
+{
+    int clipped, reference_clipped;
+    ColorMap::SetVectorized(false);
+    std::vector<T> reference = generate<T>(p, &reference_clipped);
+    ColorMap::SetVectorized(true);
+    ColorMap::SetFastSRGB(false);
+    std::vector<T> vectorized = generate<T>(p, &clipped);
+    c.expect(clipped == reference_clipped && same(vectorized, reference),
+            std::string("vectorized ") + component + " conversion", p);
+    ColorMap::SetFastSRGB(true);
+    std::vector<T> fast = generate<T>(p, &clipped);
+    c.expect(clipped == reference_clipped && same(fast, reference),
+            std::string("fast sRGB ") + component + " conversion", p);
+    ColorMap::SetThreads(4);
+    std::vector<T> threaded = generate<T>(p, &clipped);
+    ColorMap::SetThreads(1);
+    c.expect(clipped == reference_clipped && same(threaded, reference),
+            std::string("threaded ") + component + " generation", p);
+}
+
+// Compare the other ways to get the same colors with Generate()
+static void check_paths(checker& c, const ColorMap::Parameters& p)
+{
+    int n = p.n;
+    int clipped, repeated_clipped;
+    std::vector<float> reference = generate<float>(p, &clipped);
+    std::vector<float> repeated = generate<float>(p, &repeated_clipped);
+    c.expect(repeated_clipped == clipped && same(repeated, reference), "repeated generation (caches)", p);
+
+    ColorMap::Evaluator e(p);
+    std::vector<float> filled(3 * size_t(n));
+    c.expect(e.Fill(filled.data()) == clipped && same(filled, reference), "Evaluator::Fill", p);
+    // Positions in random order, evaluated together and one at a time, so
+    // that lookups which continue from the previous position are exercised
+    int count = std::min(n, 1000);
+    std::vector<float> t(count);
+    for (int i = 0; i < count; i++)
+        t[i] = (i == 0 ? 0.0f : i == 1 ? 1.0f : c.uniform(0.0f, 1.0f));
+    std::shuffle(t.begin(), t.end(), c.rng);
+    std::vector<float> together(3 * count), single(3 * count);
+    e.Evaluate(count, t.data(), together.data());
+    for (int i = 0; i < count; i++)
+        e.Evaluate(1, &(t[i]), &(single[3 * i]));
+    c.expect(same(together, single), "Evaluator::Evaluate in random order", p);
+
+    int clipped8;
+    std::vector<unsigned char> reference8 = generate<unsigned char>(p, &clipped8);
+    ColorMap::Context context(2);
+    std::vector<unsigned char> colormap8(3 * size_t(n));
+    c.expect(context.Generate(p, colormap8.data()) == clipped8 && same(colormap8, reference8),
+            "Context::Generate", p);
+    c.expect(ColorMap::GenerateFromDefinition(ColorMap::ToDefinition(p).c_str(), 0, colormap8.data()) == clipped8
+            && same(colormap8, reference8), "definition round trip", p);
+
+    int width = ColorMap::AtlasWidth(1, &p);
+    std::vector<unsigned char> atlas(3 * size_t(width));
+    ColorMap::GenerateAtlas(1, &p, width, atlas.data());
+    bool atlas_ok = (std::memcmp(atlas.data(), reference8.data(), 3 * size_t(n)) == 0);
+    for (int k = n; k < width; k++)
+        atlas_ok = atlas_ok && std::memcmp(&(atlas[3 * k]), &(reference8[3 * (n - 1)]), 3) == 0;
+    c.expect(atlas_ok, "atlas row", p);
+
+    // Every format must work for every n; the text formats must only
+    // contain finite numbers
+    for (int f = 0; f < int(sizeof(format_names) / sizeof(format_names[0])); f++) {
+        std::string out;
+        ColorMap::StringWriter writer(out);
+        bool ok = ColorMap::Export(static_cast<ColorMap::Format>(f), n, reference8.data(), writer);
+        if (f == ColorMap::FormatCSV || f == ColorMap::FormatJSON || f == ColorMap::FormatPPM)
+            ok = ok && out.find("nan") == std::string::npos && out.find("inf") == std::string::npos;
+        c.expect(ok, std::string(format_names[f]) + " export", p);
+    }
+
+    // 16 bit images, with and without the lookup table
+    ColorMap::ApplyParameters ap(c.uniform(0.0f, 30000.0f), c.uniform(35000.0f, 65535.0f));
+    ap.interpolation = (c.uniform_int(0, 1) ? ColorMap::InterpolationLinear : ColorMap::InterpolationNearest);
+    ap.channels = c.uniform_int(3, 4);
+    const int image_width = 64, image_height = 16;
+    std::vector<unsigned short> values(image_width * image_height);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = c.uniform_int(0, 65535);
+    std::vector<unsigned char> direct(ap.channels * values.size()), via_lut(ap.channels * values.size());
+    std::vector<unsigned char> lut(ColorMap::ApplyLUTSize(ap));
+    ColorMap::Apply(n, reference8.data(), ap, image_width, image_height, values.data(), 0, direct.data());
+    ColorMap::BuildApplyLUT(n, reference8.data(), ap, lut.data());
+    ColorMap::ApplyLUT(lut.data(), ap, image_width, image_height, values.data(), 0, via_lut.data());
+    c.expect(same(direct, via_lut), "ApplyLUT", p);
+}
+
+// Run the checks for count random parameter sets. Returns false if any failed.
+// Check that a warmed up context generates color maps without heap
+// allocations. Distinct palettes are computed per call and are excluded.
+template<typename T>
+static void check_allocations(checker& c, const char* what)
+{
+    ColorMap::Context context(1);
+    std::vector<T> colormap(3 * 1000);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < ColorMap::TypeCount; i++) {
+            ColorMap::Parameters p(static_cast<ColorMap::Type>(i), 1000);
+            if (p.type == ColorMap::TypeDistinct)
+                continue;
+            unsigned long long a0 = allocations;
+            context.Generate(p, colormap.data());
+            bool ok = (allocations == a0);
+            if (pass == 1)
+                c.expect(ok, std::string(what) + " generation without allocation", p);
+        }
+    }
+}
+
+static bool check(int count, unsigned int seed)
+{
+    checker c(seed);
+    int types = ColorMap::TypeCount;
+    for (int i = 0; i < count; i++) {
+        std::vector<float> hue_values, hue_positions;
+        ColorMap::Parameters p = random_parameters(c, static_cast<ColorMap::Type>(i % types),
+                hue_values, hue_positions);
+        check_generate<unsigned char>(c, p, "8 bit");
+        check_generate<unsigned short>(c, p, "16 bit");
+        check_generate<float>(c, p, "float");
+        check_generate<ColorMap::half>(c, p, "half float");
+        check_paths(c, p);
+    }
+    check_allocations<unsigned char>(c, "8 bit");
+    check_allocations<unsigned short>(c, "16 bit");
+    check_allocations<float>(c, "float");
+    check_allocations<ColorMap::half>(c, "half float");
+    // -1 means that the fast quantization is never used
+    long long mismatches = ColorMap::CheckFastSRGB();
+    c.comparisons++;
+    if (mismatches > 0) {
+        c.failures++;
+        fprintf(stderr, "check failed: fast sRGB quantization: %lld mismatch(es)\n", mismatches);
+    }
+    printf("%d parameter set(s), %lld comparison(s), %lld failure(s)\n", count, c.comparisons, c.failures);
+    return c.failures == 0;
+}
+
+/* Baselines: the CSV output of an earlier run */
+
+static std::string case_key(const std::string& kind, const std::string& name, int n)
+{
+    return kind + "," + name + "," + std::to_string(n);
+}
+
+// Read the time per entry for each case. Returns false if the file cannot be read.
+static bool read_baseline(const char* filename, std::map<std::string, double>& baseline)
+{
+    FILE* f = std::fopen(filename, "r");
+    if (!f)
+        return false;
+    char line[512];
+    while (std::fgets(line, sizeof(line), f)) {
+        char kind[128], name[128];
+        int n;
+        long long reps;
+        double ns_per_entry;
+        if (std::sscanf(line, "%127[^,],%127[^,],%d,%lld,%lf", kind, name, &n, &reps, &ns_per_entry) == 5)
+            baseline[case_key(kind, name, n)] = ns_per_entry;
+    }
+    bool ok = !std::ferror(f);
+    std::fclose(f);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    struct option options[] = {
+        { "help",      no_argument,       0, 'H' },
+        { "format",    required_argument, 0, 'f' },
+        { "max-n",     required_argument, 0, 'n' },
+        { "n-factor",  required_argument, 0, 'F' },
+        { "min-time",  required_argument, 0, 'm' },
+        { "threads",   required_argument, 0, 'j' },
+        { "filter",    required_argument, 0, 'k' },
+        { "check-srgb", no_argument,      0, 'S' },
+        { "check",     optional_argument, 0, 'C' },
+        { "seed",      required_argument, 0, 's' },
+        { "baseline",  required_argument, 0, 'b' },
+        { "tolerance", required_argument, 0, 'T' },
+        { 0, 0, 0, 0 }
+    };
+    bool print_help = false;
+    bool json = false;
+    int max_n = 1 << 22;
+    int n_factor = 4;
+    double min_time = 0.1;
+    int threads = 1;
+    const char* filter = NULL;
+    bool check_srgb = false;
+    int check_count = 0;
+    unsigned int seed = 1;
+    const char* baseline_file = NULL;
+    double tolerance = 0.25;
+    for (;;) {
+        int c = getopt_long(argc, argv, "Hf:n:F:m:j:k:", options, NULL);
+        if (c == -1)
+            break;
+        switch (c) {
+        case 'H':
+            print_help = true;
+            break;
+        case 'f':
+            json = (std::strcmp(optarg, "json") == 0);
+            if (!json && std::strcmp(optarg, "csv") != 0) {
+                fprintf(stderr, "Invalid argument for option -f|--format.\n");
+                return 1;
+            }
+            break;
+        case 'n':
+            max_n = std::atoi(optarg);
+            break;
+        case 'F':
+            n_factor = std::atoi(optarg);
+            break;
+        case 'm':
+            min_time = std::atof(optarg);
+            break;
+        case 'j':
+            threads = std::atoi(optarg);
+            break;
+        case 'k':
+            filter = optarg;
+            break;
+        case 'S':
+            check_srgb = true;
+            break;
+        case 'C':
+            check_count = (optarg ? std::atoi(optarg) : 200);
+            if (check_count < 1) {
+                fprintf(stderr, "Invalid argument for option --check.\n");
+                return 1;
+            }
+            break;
+        case 's':
+            seed = std::strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            baseline_file = optarg;
+            break;
+        case 'T':
+            tolerance = std::atof(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        fprintf(stderr, "%s: Invalid argument %s.\n", argv[0], argv[optind]);
+        return 1;
+    }
+    if (print_help) {
+        printf("Usage: %s [option...]\n"
+                "Measures the generators and exporters and prints the results to standard output.\n"
+                "Options:\n"
+                "  [-f|--format=csv|json]     Set output format\n"
+                "  [-n|--max-n=N]             Set the largest number of colors (default 4194304)\n"
+                "  [-F|--n-factor=F]          Multiply the number of colors by F from one\n"
+                "                             measurement to the next, starting at 2 (default 4)\n"
+                "  [-m|--min-time=S]          Run each measurement for at least S seconds (default 0.1)\n"
+                "  [-j|--threads=N]           Set number of threads (0 = all cores, default 1)\n"
+                "  [-k|--filter=NAME]         Only run cases whose name contains NAME\n"
+                "  [--check-srgb]             Instead of measuring, compare the fast sRGB\n"
+                "                             quantization with the reference for all inputs\n"
+                "  [--check[=COUNT]]          Instead of measuring, compare all fast paths with\n"
+                "                             their references for COUNT random parameter sets\n"
+                "                             (default 200), and the fast sRGB quantization for\n"
+                "                             all inputs; fails if any result differs\n"
+                "  [--seed=S]                 Set the seed for the random parameters (default 1)\n"
+                "  [--baseline=FILE]          Compare with the CSV results of an earlier run in FILE\n"
+                "                             and fail if a case is slower than allowed\n"
+                "  [--tolerance=T]            Allow cases to be slower by the fraction T\n"
+                "                             (default 0.25)\n",
+                argv[0]);
+        return 0;
+    }
+    if (max_n < 2 || n_factor < 2 || threads < 0 || !(tolerance >= 0.0)) {
+        fprintf(stderr, "Invalid arguments.\n");
+        return 1;
+    }
+    std::map<std::string, double> baseline;
+    if (baseline_file && !read_baseline(baseline_file, baseline)) {
+        fprintf(stderr, "Cannot read %s: %s\n", baseline_file, strerror(errno));
+        return 1;
+    }
+
+    if (check_count > 0) {
+        // the checks compare one thread with several themselves
+        ColorMap::SetThreads(1);
+        return check(check_count, seed) ? 0 : 1;
+    }
+
+    ColorMap::SetThreads(threads);
+
+    if (check_srgb) {
+        long long mismatches = ColorMap::CheckFastSRGB();
+        if (mismatches < 0) {
+            printf("fast sRGB quantization is not available\n");
+            return 1;
+        }
+        printf("fast sRGB quantization: %lld mismatch(es)\n", mismatches);
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    std::vector<bench_case> cases;
+    for (int i = 0; i < ColorMap::TypeCount; i++)
+        cases.push_back(bench_case { "generate", ColorMap::TypeName(static_cast<ColorMap::Type>(i)), i, 0 });
+    for (int i = 0; i < int(sizeof(format_names) / sizeof(format_names[0])); i++)
+        cases.push_back(bench_case { "export", format_names[i], 0, i });
+    cases.push_back(bench_case { "export", "to-csv-string", 0, -1 });
+    cases.push_back(bench_case { "export", "to-json-string", 0, -2 });
+    cases.push_back(bench_case { "export", "to-ppm-string", 0, -3 });
+    cases.push_back(bench_case { "export", "archive", 0, -4 });
+
+    std::vector<int> sizes;
+    for (long long n = 2; n <= max_n; n *= n_factor)
+        sizes.push_back(n);
+    if (sizes.back() != max_n)
+        sizes.push_back(max_n);
+
+    if (json)
+        printf("[\n");
+    else
+        printf("kind,name,n,reps,ns_per_entry,allocations_per_call,bytes_per_call,peak_rss_kib\n");
+    bool first = true;
+    int regressions = 0;
+    for (size_t i = 0; i < cases.size(); i++) {
+        const bench_case& c = cases[i];
+        if (filter && c.name.find(filter) == std::string::npos)
+            continue;
+        for (size_t j = 0; j < sizes.size(); j++) {
+            result r = measure(c, sizes[j], min_time);
+            if (json) {
+                printf("%s  { \"kind\": \"%s\", \"name\": \"%s\", \"n\": %d, \"reps\": %lld, "
+                        "\"ns_per_entry\": %.3f, \"allocations_per_call\": %.2f, "
+                        "\"bytes_per_call\": %.0f, \"peak_rss_kib\": %ld }",
+                        first ? "" : ",\n", c.kind.c_str(), c.name.c_str(), sizes[j], r.reps,
+                        r.ns_per_entry, r.allocations_per_call, r.bytes_per_call, r.peak_rss_kib);
+            } else {
+                printf("%s,%s,%d,%lld,%.3f,%.2f,%.0f,%ld\n",
+                        c.kind.c_str(), c.name.c_str(), sizes[j], r.reps,
+                        r.ns_per_entry, r.allocations_per_call, r.bytes_per_call, r.peak_rss_kib);
+            }
+            first = false;
+            fflush(stdout);
+            auto b = baseline.find(case_key(c.kind, c.name, sizes[j]));
+            if (b != baseline.end() && r.ns_per_entry > b->second * (1.0 + tolerance)) {
+                fprintf(stderr, "regression: %s %s n=%d: %.3f ns per entry, baseline %.3f ns\n",
+                        c.kind.c_str(), c.name.c_str(), sizes[j], r.ns_per_entry, b->second);
+                regressions++;
+            }
+        }
+    }
+    if (json)
+        printf("\n]\n");
+
+    if (regressions > 0) {
+        fprintf(stderr, "%d case(s) slower than the baseline allows\n", regressions);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdio>
+
+#include <unistd.h>
+
+#include "cache.hpp"
+#include "instrumentation.hpp"
+
+namespace ColorMap {
+
+// Incremented whenever the generated colors or the cache file layout change,
+// so that old cache directories are not used
+static const int cache_version = 1;
+
+unsigned long long CacheKey(const Parameters& parameters, Format format)
+{
+    // 64 bit FNV-1a of the parameter hash and the settings
+    unsigned long long h = 14695981039346656037ULL;
+    unsigned long long values[4] = {
+        Hash(parameters), static_cast<unsigned long long>(format),
+        ExactBlackBody() ? 1ULL : 0ULL, static_cast<unsigned long long>(cache_version)
+    };
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 8; j++) {
+            h ^= (values[i] >> (8 * j)) & 0xff;
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+ResultCache::ResultCache(size_t max_bytes, const char* directory) :
+    _max_bytes(max_bytes), _bytes(0), _directory(directory ? directory : "")
+{
+}
+
+std::string ResultCache::file_name(unsigned long long key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.gcm", key);
+    return _directory + name;
+}
+
+void ResultCache::insert(unsigned long long key, const std::string& data, int clipped)
+{
+    auto it = _index.find(key);
+    if (it != _index.end()) {
+        _bytes -= it->second->data.size();
+        _entries.erase(it->second);
+        _index.erase(it);
+    }
+    if (data.size() > _max_bytes)
+        return;
+    _entries.push_front(entry { key, clipped, data });
+    _index[key] = _entries.begin();
+    _bytes += data.size();
+    while (_bytes > _max_bytes) {
+        const entry& e = _entries.back();
+        _bytes -= e.data.size();
+        _index.erase(e.key);
+        _entries.pop_back();
+    }
+}
+
+/* A cache file consists of the line "gencolormap-cache <version> <key>
+ * <clipped> <size>" followed by <size> bytes of data. */
+
+bool ResultCache::lookup(unsigned long long key, std::string& data, int* clipped)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it != _index.end()) {
+        _entries.splice(_entries.begin(), _entries, it->second);
+        data = it->second->data;
+        if (clipped)
+            *clipped = it->second->clipped;
+        return true;
+    }
+    if (_directory.empty())
+        return false;
+
+    FILE* f = fopen(file_name(key).c_str(), "rb");
+    if (!f)
+        return false;
+    int version, file_clipped;
+    unsigned long long file_key;
+    size_t size;
+    bool ok = (fscanf(f, "gencolormap-cache %d %llx %d %zu", &version, &file_key, &file_clipped, &size) == 4
+            && version == cache_version && file_key == key && getc(f) == '\n');
+    if (ok) {
+        std::string file_data(size, '\0');
+        ok = (size == 0 || fread(&(file_data[0]), 1, size, f) == size);
+        if (ok) {
+            data.swap(file_data);
+            if (clipped)
+                *clipped = file_clipped;
+            insert(key, data, file_clipped);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+bool ResultCache::Lookup(unsigned long long key, std::string& data, int* clipped)
+{
+    bool found = lookup(key, data, clipped);
+    Count(found ? CounterCacheHits : CounterCacheMisses, 1);
+    return found;
+}
+
+void ResultCache::Store(unsigned long long key, const std::string& data, int clipped)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    insert(key, data, clipped);
+    if (_directory.empty())
+        return;
+
+    // Write to a temporary file first so that concurrent readers, possibly in
+    // other processes, never see a partial file
+    std::string name = file_name(key);
+    std::string tmp_name = name + "." + std::to_string(getpid()) + ".tmp";
+    FILE* f = fopen(tmp_name.c_str(), "wb");
+    if (!f)
+        return;
+    bool ok = (fprintf(f, "gencolormap-cache %d %016llx %d %zu\n", cache_version, key, clipped, data.size()) > 0
+            && fwrite(data.data(), 1, data.size(), f) == data.size());
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp_name.c_str(), name.c_str()) != 0)
+        remove(tmp_name.c_str());
+}
+
+}
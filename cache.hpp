@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_CACHE_HPP
+#define COLORMAP_CACHE_HPP
+
+#include <cstddef>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+#include "colormap.hpp"
+#include "export.hpp"
+
+/* Result cache.
+ *
+ * A ResultCache stores exported color maps under a key computed from the
+ * canonical parameters (see Hash() in colormap.hpp) and the output format, so
+ * that repeated requests for the same color map become a lookup. Results are
+ * kept in memory with least-recently-used eviction, and optionally also in a
+ * cache directory so that they survive the process.
+ *
+ * A ResultCache can be used by several threads at the same time.
+ */
+
+namespace ColorMap {
+
+// The cache key of the color map described by the parameters, exported in the
+// given format. The key also covers the global settings that change the
+// generated colors, e.g. SetExactBlackBody().
+unsigned long long CacheKey(const Parameters& parameters, Format format);
+
+class ResultCache {
+private:
+    struct entry {
+        unsigned long long key;
+        int clipped;
+        std::string data;
+    };
+
+    size_t _max_bytes;
+    size_t _bytes;
+    std::string _directory;
+    std::list<entry> _entries;  // most recently used first
+    std::unordered_map<unsigned long long, std::list<entry>::iterator> _index;
+    std::mutex _mutex;
+
+    std::string file_name(unsigned long long key) const;
+    void insert(unsigned long long key, const std::string& data, int clipped);
+    bool lookup(unsigned long long key, std::string& data, int* clipped);
+
+public:
+    // Create a cache that holds up to max_bytes of data in memory. If directory
+    // is not NULL, results are also read from and written to that directory,
+    // which must exist.
+    explicit ResultCache(size_t max_bytes = 64 << 20, const char* directory = NULL);
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Look up a result. Returns false if the key is not in the cache.
+    bool Lookup(unsigned long long key, std::string& data, int* clipped = NULL);
+
+    // Store a result. Failure to write to the cache directory is not an
+    // error; the result is then only cached in memory.
+    void Store(unsigned long long key, const std::string& data, int clipped);
+};
+
+}
+
+#endif
@@ -23,10 +23,22 @@
  */
 
 #include <vector>
+#include <string>
+#include <set>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
+#include <cerrno>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <getopt.h>
 extern char *optarg;
@@ -34,61 +46,172 @@ extern int optind;
 
 #include "colormap.hpp"
 #include "export.hpp"
+#include "sweep.hpp"
+#include "context.hpp"
+#include "cache.hpp"
+#include "analysis.hpp"
+#include "instrumentation.hpp"
+#include "definition.hpp"
 
-enum type {
-    brewer_seq,
-    brewer_div,
-    brewer_qual,
-    puseq_lightness,
-    puseq_saturation,
-    puseq_rainbow,
-    puseq_blackbody,
-    puseq_multihue,
-    pudiv_lightness,
-    pudiv_saturation,
-    puqual_hue,
-    cubehelix,
-    moreland,
-    mcnames
+/* The names of the output formats for the -f|--format option, in the order of
+ * ColorMap::Format */
+static const char* format_names[] = {
+    "csv",
+    "json",
+    "ppm",
+    "ppm-binary",
+    "raw-rgb8",
+    "raw-rgb32f",
+    "cmap",
+    "png"
 };
 
-enum format {
-    csv,
-    json,
-    ppm
+/* The names of the parameters for the --sweep option, in the order of
+ * ColorMap::SweepParameter */
+static const char* sweep_names[] = {
+    "hue",
+    "divergence",
+    "contrast",
+    "saturation",
+    "saturation-range",
+    "brightness",
+    "warmth",
+    "lightness",
+    "lightness-range",
+    "rotations",
+    "temperature",
+    "temperature-range",
+    "gamma",
+    "periods"
 };
 
-int main(int argc, char* argv[])
+/* Hue and divergence are given in degrees on the command line */
+static bool sweep_in_degrees(int parameter)
 {
-    bool print_version = false;
-    bool print_help = false;
-    int format = csv;
-    int type = brewer_seq;
-    int n = 256;
-    float hue = -1.0f;
-    float divergence = -1.0f;
-    float contrast = -1.0f;
-    float saturation = -1.0f;
-    float saturation_range = -1.0f;
-    float brightness = -1.0f;
-    float warmth = -1.0f;
-    float lightness = -1.0f;
-    float lightness_range = -1.0f;
-    float rotations = NAN;
-    float temperature = -1.0f;
-    float temperature_range = -1.0f;
+    return parameter == ColorMap::SweepHue || parameter == ColorMap::SweepDivergence;
+}
+
+/* Options that apply to the whole program run */
+class program_options {
+public:
+    bool print_version;
+    bool print_help;
+    int format;                 // the first of the formats
+    std::vector<int> formats;
+    const char* output;
+    const char* batch;
+    int threads;
+    bool exact_blackbody;
+    const char* archive;
+    std::vector<ColorMap::SweepRange> sweep;
+    bool sweep_error;
+    bool uniformity;
+    int analyze;                // 0 = off, 1 = summary, 2 = steps, -1 = invalid
+    bool arc_length;
+    bool serve;
+    const char* serve_socket;
+    const char* cache;
+    bool stats;
+    const char* trace;
+    const char* atlas;
+    bool definition;
+
+    program_options() :
+        print_version(false), print_help(false), format(ColorMap::FormatCSV), output(NULL), batch(NULL), threads(1),
+        exact_blackbody(false), archive(NULL), sweep_error(false), uniformity(false), analyze(0), arc_length(false),
+        serve(false), serve_socket(NULL), cache(NULL), stats(false), trace(NULL), atlas(NULL), definition(false)
+    {
+    }
+};
+
+/* Options that describe one color map. Values that were not given are negative
+ * or NaN, and are replaced by the defaults of the chosen type. */
+class map_options {
+public:
+    std::string name;
+    int type;
+    int n;
+    float hue;
+    float divergence;
+    float contrast;
+    float saturation;
+    float saturation_range;
+    float brightness;
+    float warmth;
+    float lightness;
+    float lightness_range;
+    float rotations;
+    float temperature;
+    float temperature_range;
     std::vector<float> hue_values;
     std::vector<float> hue_positions;
-    float gamma = -1.0f;
-    bool have_color0 = false;
+    float gamma;
+    bool have_color0;
     unsigned char color0[3];
-    bool have_color1 = false;
+    bool have_color1;
     unsigned char color1[3];
-    float periods = NAN;
+    float periods;
+
+    map_options() :
+        type(ColorMap::TypeBrewerSequential), n(256),
+        hue(-1.0f), divergence(-1.0f), contrast(-1.0f),
+        saturation(-1.0f), saturation_range(-1.0f),
+        brightness(-1.0f), warmth(-1.0f),
+        lightness(-1.0f), lightness_range(-1.0f),
+        rotations(NAN), temperature(-1.0f), temperature_range(-1.0f),
+        gamma(-1.0f), have_color0(false), have_color1(false), periods(NAN)
+    {
+    }
+};
+
+/* A color map to generate: the parameters, and the storage for the hue lists
+ * they refer to */
+class map_request {
+public:
+    std::string name;
+    ColorMap::Parameters parameters;
+    std::vector<float> hue_values;
+    std::vector<float> hue_positions;
+
+    // Get the parameters. This updates the hue list pointers, since the
+    // vectors might have moved since the request was created. Without lists
+    // of its own, the parameters keep pointing to the type defaults.
+    const ColorMap::Parameters& get()
+    {
+        if (parameters.hues > 0 && hue_values.size() == size_t(parameters.hues)
+                && hue_positions.size() == size_t(parameters.hues)) {
+            parameters.hue_values = hue_values.data();
+            parameters.hue_positions = hue_positions.data();
+        }
+        return parameters;
+    }
+};
+
+/* Parse command line arguments. Program options are only accepted if po is
+ * not NULL, except for the format, which is also accepted if format is not
+ * NULL. Returns false on error. */
+static bool parse_options(int argc, char* argv[], program_options* po, map_options& mo, int* format = NULL)
+{
     struct option options[] = {
         { "version",           no_argument,       0, 'v' },
         { "help",              no_argument,       0, 'H' },
         { "format",            required_argument, 0, 'f' },
+        { "output",            required_argument, 0, 'o' },
+        { "batch",             required_argument, 0, 'B' },
+        { "threads",           required_argument, 0, 'j' },
+        { "exact-blackbody",   no_argument,       0, 'E' },
+        { "archive",           required_argument, 0, 'a' },
+        { "name",              required_argument, 0, 'N' },
+        { "sweep",             required_argument, 0, 'W' },
+        { "uniformity",        no_argument,       0, 'U' },
+        { "analyze",           optional_argument, 0, 'Y' },
+        { "arc-length",        no_argument,       0, 'K' },
+        { "serve",             optional_argument, 0, 'Z' },
+        { "cache",             required_argument, 0, 'C' },
+        { "stats",             no_argument,       0, 'I' },
+        { "trace",             required_argument, 0, 'X' },
+        { "atlas",             required_argument, 0, 'G' },
+        { "definition",        no_argument,       0, 'D' },
         { "type",              required_argument, 0, 't' },
         { "n",                 required_argument, 0, 'n' },
         { "hue",               required_argument, 0, 'h' },
@@ -112,82 +235,166 @@ int main(int argc, char* argv[])
         { 0, 0, 0, 0 }
     };
 
+    optind = 0; // reinitialize getopt so that we can parse more than one argument vector
     for (;;) {
-        int c = getopt_long(argc, argv, "vHf:t:n:h:d:c:s:S:b:w:l:L:r:T:R:V:P::g:A:O:p:", options, NULL);
+        int c = getopt_long(argc, argv, "vHf:o:B:j:t:n:h:d:c:s:S:b:w:l:L:r:T:R:V:P::g:A:O:p:", options, NULL);
         if (c == -1)
             break;
+        if (c == 'f' && !po && format) {
+            *format = -1;
+            for (int i = 0; i < int(sizeof(format_names) / sizeof(format_names[0])); i++) {
+                if (strcmp(optarg, format_names[i]) == 0) {
+                    *format = i;
+                    break;
+                }
+            }
+            continue;
+        }
+        if (!po && (c == 'v' || c == 'H' || c == 'f' || c == 'o' || c == 'B' || c == 'j' || c == 'E' || c == 'a'
+                    || c == 'W' || c == 'U' || c == 'Z' || c == 'C' || c == 'Y' || c == 'K'
+                    || c == 'I' || c == 'X' || c == 'G' || c == 'D')) {
+            fprintf(stderr, "%s: Only color map options are allowed here.\n", argv[0]);
+            return false;
+        }
         switch (c) {
         case 'v':
-            print_version = true;
+            po->print_version = true;
             break;
         case 'H':
-            print_help = true;
+            po->print_help = true;
             break;
         case 'f':
-            format = (strcmp(optarg, "csv") == 0 ? csv
-                    : strcmp(optarg, "json") == 0 ? json
-                    : strcmp(optarg, "ppm") == 0 ? ppm
-                    : -1);
+            {
+                int format = -1;
+                for (int i = 0; i < int(sizeof(format_names) / sizeof(format_names[0])); i++) {
+                    if (strcmp(optarg, format_names[i]) == 0) {
+                        format = i;
+                        break;
+                    }
+                }
+                if (std::find(po->formats.begin(), po->formats.end(), format) == po->formats.end())
+                    po->formats.push_back(format);
+            }
+            break;
+        case 'o':
+            po->output = optarg;
+            break;
+        case 'B':
+            po->batch = optarg;
+            break;
+        case 'j':
+            po->threads = atoi(optarg);
+            break;
+        case 'E':
+            po->exact_blackbody = true;
+            break;
+        case 'a':
+            po->archive = optarg;
+            break;
+        case 'N':
+            mo.name = optarg;
+            break;
+        case 'W':
+            {
+                ColorMap::SweepRange range;
+                const char* colon = strchr(optarg, ':');
+                int parameter = -1;
+                if (colon) {
+                    for (int i = 0; i < int(sizeof(sweep_names) / sizeof(sweep_names[0])); i++) {
+                        if (strlen(sweep_names[i]) == size_t(colon - optarg)
+                                && strncmp(optarg, sweep_names[i], colon - optarg) == 0) {
+                            parameter = i;
+                            break;
+                        }
+                    }
+                }
+                if (parameter < 0 || std::sscanf(colon + 1, "%f:%f:%d", &range.first, &range.last, &range.steps) != 3
+                        || range.steps < 1) {
+                    po->sweep_error = true;
+                } else {
+                    range.parameter = static_cast<ColorMap::SweepParameter>(parameter);
+                    if (sweep_in_degrees(parameter)) {
+                        range.first *= M_PI / 180.0;
+                        range.last *= M_PI / 180.0;
+                    }
+                    po->sweep.push_back(range);
+                }
+            }
+            break;
+        case 'U':
+            po->uniformity = true;
+            break;
+        case 'Y':
+            po->analyze = (!optarg ? 1 : strcmp(optarg, "steps") == 0 ? 2 : -1);
+            break;
+        case 'K':
+            po->arc_length = true;
+            break;
+        case 'Z':
+            po->serve = true;
+            po->serve_socket = optarg;
+            break;
+        case 'C':
+            po->cache = optarg;
+            break;
+        case 'I':
+            po->stats = true;
+            break;
+        case 'X':
+            po->trace = optarg;
+            break;
+        case 'G':
+            po->atlas = optarg;
+            break;
+        case 'D':
+            po->definition = true;
             break;
         case 't':
-            type = (strcmp(optarg, "brewer-sequential") == 0 ? brewer_seq
-                    : strcmp(optarg, "brewer-diverging") == 0 ? brewer_div
-                    : strcmp(optarg, "brewer-qualitative") == 0 ? brewer_qual
-                    : strcmp(optarg, "pusequential-lightness") == 0 ? puseq_lightness
-                    : strcmp(optarg, "pusequential-saturation") == 0 ? puseq_saturation
-                    : strcmp(optarg, "pusequential-rainbow") == 0 ? puseq_rainbow
-                    : strcmp(optarg, "pusequential-blackbody") == 0 ? puseq_blackbody
-                    : strcmp(optarg, "pusequential-multihue") == 0 ? puseq_multihue
-                    : strcmp(optarg, "pudiverging-lightness") == 0 ? pudiv_lightness
-                    : strcmp(optarg, "pudiverging-saturation") == 0 ? pudiv_saturation
-                    : strcmp(optarg, "puqualitative-hue") == 0 ? puqual_hue
-                    : strcmp(optarg, "cubehelix") == 0 ? cubehelix
-                    : strcmp(optarg, "moreland") == 0 ? moreland
-                    : strcmp(optarg, "mcnames") == 0 ? mcnames
-                    : -1);
+            mo.type = ColorMap::ParseTypeName(optarg);
             break;
         case 'n':
-            n = atoi(optarg);
+            mo.n = atoi(optarg);
             break;
         case 'h':
-            hue = atof(optarg) * M_PI / 180.0;
+            mo.hue = atof(optarg) * M_PI / 180.0;
             break;
         case 'd':
-            divergence = atof(optarg) * M_PI / 180.0;
+            mo.divergence = atof(optarg) * M_PI / 180.0;
             break;
         case 'c':
-            contrast = atof(optarg);
+            mo.contrast = atof(optarg);
             break;
         case 's':
-            saturation = atof(optarg);
+            mo.saturation = atof(optarg);
             break;
         case 'S':
-            saturation_range = atof(optarg);
+            mo.saturation_range = atof(optarg);
             break;
         case 'b':
-            brightness = atof(optarg);
+            mo.brightness = atof(optarg);
             break;
         case 'w':
-            warmth = atof(optarg);
+            mo.warmth = atof(optarg);
             break;
         case 'l':
-            lightness = atof(optarg);
+            mo.lightness = atof(optarg);
             break;
         case 'L':
-            lightness_range = atof(optarg);
+            mo.lightness_range = atof(optarg);
             break;
         case 'r':
-            rotations = atof(optarg);
+            mo.rotations = atof(optarg);
             break;
         case 'T':
-            temperature = atof(optarg);
+            mo.temperature = atof(optarg);
             break;
         case 'R':
-            temperature_range = atof(optarg);
+            mo.temperature_range = atof(optarg);
             break;
         case 'V':
+            mo.hue_values.clear();
             for (;;) {
-                hue_values.push_back(atof(optarg) * M_PI / 180.0);
+                mo.hue_values.push_back(atof(optarg) * M_PI / 180.0);
                 optarg = strchr(optarg, ',');
                 if (!optarg)
                     break;
@@ -195,8 +402,9 @@ int main(int argc, char* argv[])
             }
             break;
         case 'P':
+            mo.hue_positions.clear();
             for (;;) {
-                hue_positions.push_back(atof(optarg));
+                mo.hue_positions.push_back(atof(optarg));
                 optarg = strchr(optarg, ',');
                 if (!optarg)
                     break;
@@ -204,25 +412,886 @@ int main(int argc, char* argv[])
             }
             break;
         case 'g':
-            gamma = atof(optarg);
+            mo.gamma = atof(optarg);
             break;
         case 'A':
-            std::sscanf(optarg, "%hhu,%hhu,%hhu", color0 + 0, color0 + 1, color0 + 2);
-            have_color0 = true;
+            std::sscanf(optarg, "%hhu,%hhu,%hhu", mo.color0 + 0, mo.color0 + 1, mo.color0 + 2);
+            mo.have_color0 = true;
             break;
         case 'O':
-            std::sscanf(optarg, "%hhu,%hhu,%hhu", color1 + 0, color1 + 1, color1 + 2);
-            have_color1 = true;
+            std::sscanf(optarg, "%hhu,%hhu,%hhu", mo.color1 + 0, mo.color1 + 1, mo.color1 + 2);
+            mo.have_color1 = true;
             break;
         case 'p':
-            periods = atof(optarg);
+            mo.periods = atof(optarg);
             break;
         default:
+            return false;
+        }
+    }
+    if (optind < argc) {
+        fprintf(stderr, "%s: Invalid argument %s.\n", argv[0], argv[optind]);
+        return false;
+    }
+    return true;
+}
+
+/* Check the color map options and turn them into a request, using the defaults
+ * of the color map type for all values that were not given. The location is
+ * used as a prefix for error messages. Returns false on error. */
+static bool make_request(const map_options& mo, const char* location, map_request& req)
+{
+    if (mo.n < 2) {
+        fprintf(stderr, "%sInvalid argument for option -n|--n.\n", location);
+        return false;
+    }
+    if (mo.type < 0) {
+        fprintf(stderr, "%sInvalid argument for option -t|--type.\n", location);
+        return false;
+    }
+
+    // the request may be reused, e.g. in a slot of the server's ring buffer
+    req = map_request();
+    req.name = mo.name;
+    ColorMap::Parameters& p = req.parameters;
+    p = ColorMap::Parameters(static_cast<ColorMap::Type>(mo.type), mo.n);
+    if (mo.hue >= 0.0f)
+        p.hue = mo.hue;
+    if (mo.divergence >= 0.0f)
+        p.divergence = mo.divergence;
+    if (mo.contrast >= 0.0f)
+        p.contrast = mo.contrast;
+    if (mo.saturation >= 0.0f)
+        p.saturation = mo.saturation;
+    if (mo.saturation_range >= 0.0f)
+        p.saturation_range = mo.saturation_range;
+    if (mo.brightness >= 0.0f)
+        p.brightness = mo.brightness;
+    if (mo.warmth >= 0.0f)
+        p.warmth = mo.warmth;
+    if (mo.lightness >= 0.0f)
+        p.lightness = mo.lightness;
+    if (mo.lightness_range >= 0.0f)
+        p.lightness_range = mo.lightness_range;
+    if (!std::isnan(mo.rotations))
+        p.rotations = mo.rotations;
+    if (mo.temperature >= 0.0f)
+        p.temperature = mo.temperature;
+    if (mo.temperature_range >= 0.0f)
+        p.temperature_range = mo.temperature_range;
+    if (mo.gamma >= 0.0f)
+        p.gamma = mo.gamma;
+    if (mo.hue_values.size() > 0 || mo.hue_positions.size() > 0) {
+        // a list that was not given is taken from the defaults of the type
+        req.hue_values = mo.hue_values;
+        if (req.hue_values.empty())
+            req.hue_values.assign(p.hue_values, p.hue_values + p.hues);
+        req.hue_positions = mo.hue_positions;
+        if (req.hue_positions.empty())
+            req.hue_positions.assign(p.hue_positions, p.hue_positions + p.hues);
+        if (req.hue_values.size() != req.hue_positions.size()) {
+            fprintf(stderr, "%sNumber of hue values and positions do not match.\n", location);
+            return false;
+        }
+        p.hues = req.hue_values.size();
+    }
+    if (mo.have_color0) {
+        for (int i = 0; i < 3; i++)
+            p.color0[i] = mo.color0[i];
+    }
+    if (mo.have_color1) {
+        for (int i = 0; i < 3; i++)
+            p.color1[i] = mo.color1[i];
+    }
+    if (!std::isnan(mo.periods))
+        p.periods = mo.periods;
+    return true;
+}
+
+/* Read a batch file with one set of color map options or one color map
+ * definition per line. Empty lines and lines starting with '#' are ignored.
+ * The options given in mo serve as defaults for each line of options. Returns
+ * false on error. */
+static bool read_batch(const char* filename, const map_options& mo, std::vector<map_request>& requests)
+{
+    FILE* f = (strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r"));
+    if (!f) {
+        fprintf(stderr, "Cannot open %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    std::string line;
+    int lineno = 0;
+    for (;;) {
+        int c = getc(f);
+        if (c != EOF && c != '\n') {
+            line.push_back(c);
+            continue;
+        }
+        if (c == EOF && line.empty())
+            break;
+        lineno++;
+        std::string location = std::string(filename) + ":" + std::to_string(lineno);
+        std::string prefix = location + ": ";
+        if (line.compare(0, strlen(ColorMap::DefinitionMagic), ColorMap::DefinitionMagic) == 0) {
+            map_request req;
+            if (!ColorMap::ParseDefinition(line.c_str(), req.parameters, req.hue_values, req.hue_positions)) {
+                fprintf(stderr, "%sInvalid color map definition.\n", prefix.c_str());
+                ok = false;
+                break;
+            }
+            requests.push_back(req);
+            line.clear();
+            if (c == EOF)
+                break;
+            continue;
+        }
+        std::vector<char*> args;
+        args.push_back(&(location[0]));
+        for (char* t = strtok(&(line[0]), " \t\r"); t; t = strtok(NULL, " \t\r"))
+            args.push_back(t);
+        if (args.size() > 1 && args[1][0] != '#') {
+            map_options line_mo = mo;
+            map_request req;
+            if (!parse_options(args.size(), args.data(), NULL, line_mo)
+                    || !make_request(line_mo, prefix.c_str(), req)) {
+                ok = false;
+                break;
+            }
+            requests.push_back(req);
+        }
+        line.clear();
+        if (c == EOF)
+            break;
+    }
+    if (ferror(f)) {
+        fprintf(stderr, "Cannot read %s: %s\n", filename, strerror(errno));
+        ok = false;
+    }
+    if (f != stdin)
+        fclose(f);
+    return ok;
+}
+
+/* The size of the in-memory result caches. A single run only needs it for
+ * repeated lines in a batch, while a server keeps it for its lifetime. */
+static const size_t cache_bytes = 64 << 20;
+static const size_t serve_cache_bytes = 256 << 20;
+
+/* Server mode: read one request per line and write one response per request.
+ *
+ * A request consists of color map options as in a batch file, plus optionally
+ * -f|--format. Empty lines and lines starting with '#' are ignored. The
+ * response to a request is the line "OK <clipped> <size>" followed by <size>
+ * bytes of the exported color map, or the line "ERROR <message>".
+ *
+ * Requests are pipelined: a client can send many requests without waiting for
+ * the responses, which are written in the order of the requests. The requests
+ * are parsed by the reading thread, and then generated and exported by a pool
+ * of workers. Each worker keeps its own ColorMap::Context and buffers, so the
+ * caches stay warm from one request to the next. All sessions share a result
+ * cache, so that repeated requests are answered without generating the color
+ * map again. */
+
+// getopt_long() and strtok() are not thread safe; with a socket, several
+// sessions may parse requests at the same time
+static std::mutex serve_parse_mutex;
+
+
+class serve_session {
+private:
+    struct job {
+        map_request request;
+        int format;
+        bool valid;
+        bool done;
+        std::string response;
+    };
+
+    FILE* _in;
+    FILE* _out;
+    const map_options& _mo;
+    int _format;
+    ColorMap::ResultCache& _cache;
+    int _workers;
+    std::vector<job> _jobs;     // ring buffer of pending jobs
+    long long _read;            // number of requests read
+    long long _started;         // number of requests taken by workers
+    long long _written;         // number of responses written
+    bool _eof;
+    bool _write_error;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+
+    job& slot(long long i)
+    {
+        return _jobs[i % _jobs.size()];
+    }
+
+    void work()
+    {
+        ColorMap::Context context(1);
+        std::vector<unsigned char> colormap;
+        std::vector<float> float_colormap;
+        std::string float_data;
+        std::string cached_data;
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;) {
+            _cond.wait(lock, [&] { return _started < _read || _eof || _write_error; });
+            if (_started == _read)
+                return;
+            job& j = slot(_started++);
+            lock.unlock();
+            if (j.valid) {
+                const ColorMap::Parameters& p = j.request.get();
+                unsigned long long key = ColorMap::CacheKey(p, ColorMap::Format(j.format));
+                const std::string* data;
+                int clipped;
+                if (_cache.Lookup(key, cached_data, &clipped)) {
+                    data = &cached_data;
+                } else if (j.format == ColorMap::FormatRawRGB32F) {
+                    float_colormap.resize(3 * p.n);
+                    clipped = context.Generate(p, float_colormap.data());
+                    float_data.clear();
+                    ColorMap::StringWriter writer(float_data);
+                    ColorMap::ExportRawRGB32F(p.n, float_colormap.data(), writer);
+                    data = &float_data;
+                } else {
+                    colormap.resize(3 * p.n);
+                    clipped = context.Generate(p, colormap.data());
+                    data = &context.Export(ColorMap::Format(j.format), p.n, colormap.data());
+                }
+                if (data != &cached_data)
+                    _cache.Store(key, *data, clipped);
+                j.response = "OK " + std::to_string(clipped) + " " + std::to_string(data->size()) + "\n";
+                j.response.append(*data);
+            }
+            lock.lock();
+            j.done = true;
+            _cond.notify_all();
+        }
+    }
+
+    void write()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (;;) {
+            _cond.wait(lock, [&] { return (_written < _read && slot(_written).done) || (_eof && _written == _read); });
+            if (_written == _read)
+                break;
+            job& j = slot(_written);
+            lock.unlock();
+            bool ok = (fwrite(j.response.data(), 1, j.response.size(), _out) == j.response.size());
+            lock.lock();
+            _written++;
+            // flush when no further response is ready, so that pipelined
+            // responses are written together
+            if (ok && !(_written < _read && slot(_written).done))
+                ok = (fflush(_out) == 0);
+            if (!ok) {
+                _write_error = true;
+                _cond.notify_all();
+                break;
+            }
+            _cond.notify_all();
+        }
+    }
+
+    // Parse a request line into a job. Returns false if the line is empty or a comment.
+    bool parse(std::string& line, long long number, job& j)
+    {
+        std::lock_guard<std::mutex> lock(serve_parse_mutex);
+        std::string location = "line " + std::to_string(number);
+        std::string prefix = location + ": ";
+        std::vector<char*> args;
+        args.push_back(&(location[0]));
+        for (char* t = strtok(&(line[0]), " \t\r"); t; t = strtok(NULL, " \t\r"))
+            args.push_back(t);
+        if (args.size() <= 1 || args[1][0] == '#')
+            return false;
+        map_options line_mo = _mo;
+        j.format = _format;
+        j.valid = (parse_options(args.size(), args.data(), NULL, line_mo, &j.format)
+                && make_request(line_mo, prefix.c_str(), j.request));
+        if (j.valid && j.format < 0) {
+            fprintf(stderr, "%sInvalid argument for option -f|--format.\n", prefix.c_str());
+            j.valid = false;
+        }
+        j.done = !j.valid;
+        if (!j.valid)
+            j.response = "ERROR Invalid request in " + location + "\n";
+        return true;
+    }
+
+public:
+    serve_session(FILE* in, FILE* out, const map_options& mo, int format, ColorMap::ResultCache& cache,
+            int workers) :
+        _in(in), _out(out), _mo(mo), _format(format), _cache(cache), _workers(workers),
+        _jobs(std::max(64, 4 * workers)),
+        _read(0), _started(0), _written(0), _eof(false), _write_error(false)
+    {
+    }
+
+    // Serve requests until the end of input. Returns false on error.
+    bool run()
+    {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < _workers; i++)
+            threads.push_back(std::thread(&serve_session::work, this));
+        std::thread writer(&serve_session::write, this);
+
+        std::string line;
+        long long number = 0;
+        bool read_error = false;
+        for (;;) {
+            int c = getc(_in);
+            if (c != EOF && c != '\n') {
+                line.push_back(c);
+                continue;
+            }
+            if (c == EOF && line.empty())
+                break;
+            number++;
+            {
+                // wait for a free slot
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond.wait(lock, [&] { return _read - _written < (long long)_jobs.size() || _write_error; });
+                if (_write_error)
+                    break;
+            }
+            // the slot is not used by anyone else until it is put into the queue
+            job& j = slot(_read);
+            if (parse(line, number, j)) {
+                // invalid requests are already done; the workers skip them
+                // and the writer reports the error in order
+                std::lock_guard<std::mutex> lock(_mutex);
+                _read++;
+                _cond.notify_all();
+            }
+            line.clear();
+            if (c == EOF)
+                break;
+        }
+        if (ferror(_in)) {
+            fprintf(stderr, "Cannot read requests: %s\n", strerror(errno));
+            read_error = true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _eof = true;
+            _cond.notify_all();
+        }
+        writer.join();
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+        if (_write_error)
+            fprintf(stderr, "Cannot write responses: %s\n", strerror(errno));
+        return !read_error && !_write_error;
+    }
+};
+
+// Serve the requests of one client connection
+static void serve_connection(int fd, const map_options* mo, int format, ColorMap::ResultCache* cache,
+        int workers)
+{
+    FILE* in = fdopen(fd, "r");
+    FILE* out = fdopen(dup(fd), "w");
+    if (in && out) {
+        serve_session session(in, out, *mo, format, *cache, workers);
+        session.run();
+    }
+    if (in)
+        fclose(in);
+    if (out)
+        fclose(out);
+}
+
+static bool serve(const program_options& po, const map_options& mo)
+{
+    int workers = (po.threads > 0 ? po.threads : std::max(1u, std::thread::hardware_concurrency()));
+    ColorMap::ResultCache cache(serve_cache_bytes, po.cache);
+    if (!po.serve_socket) {
+        serve_session session(stdin, stdout, mo, po.format, cache, workers);
+        return session.run();
+    }
+
+    // a client that disconnects early must not terminate the server
+    signal(SIGPIPE, SIG_IGN);
+    struct sockaddr_un addr;
+    if (strlen(po.serve_socket) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket name %s is too long.\n", po.serve_socket);
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create socket: %s\n", strerror(errno));
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, po.serve_socket);
+    unlink(po.serve_socket);
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", po.serve_socket, strerror(errno));
+        close(fd);
+        return false;
+    }
+    for (;;) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Cannot accept connection on %s: %s\n", po.serve_socket, strerror(errno));
+            close(fd);
+            return false;
+        }
+        std::thread(serve_connection, client, &mo, po.format, &cache, workers).detach();
+    }
+}
+
+/* Generate color maps with a single call and export each of them into a
+ * string in the given format. */
+static void generate_exports(int format, size_t count, const ColorMap::Parameters* parameters,
+        std::string* data, int* clipped)
+{
+    size_t total_n = 0;
+    for (size_t i = 0; i < count; i++)
+        total_n += parameters[i].n;
+    if (format == ColorMap::FormatRawRGB32F) {
+        std::vector<float> colormaps(3 * total_n);
+        ColorMap::Generate(count, parameters, colormaps.data(), clipped);
+        const float* colormap = colormaps.data();
+        for (size_t i = 0; i < count; i++) {
+            ColorMap::StringWriter writer(data[i]);
+            ColorMap::ExportRawRGB32F(parameters[i].n, colormap, writer);
+            colormap += 3 * parameters[i].n;
+        }
+    } else {
+        std::vector<unsigned char> colormaps(3 * total_n);
+        ColorMap::Generate(count, parameters, colormaps.data(), clipped);
+        const unsigned char* colormap = colormaps.data();
+        for (size_t i = 0; i < count; i++) {
+            ColorMap::StringWriter writer(data[i]);
+            ColorMap::Export(ColorMap::Format(format), parameters[i].n, colormap, writer);
+            colormap += 3 * parameters[i].n;
+        }
+    }
+}
+
+/* Analysis of many color maps, one per parallel task */
+struct analyze_job {
+    map_request* requests;
+    bool arc_length;
+    std::vector<ColorMap::Analysis> results;
+};
+
+// Analyze a color map, optionally with its colors evenly spaced in arc length
+static ColorMap::Analysis analyze(const ColorMap::Parameters& p, bool arc_length,
+        float* delta_e76 = NULL, float* delta_e2000 = NULL)
+{
+    if (!arc_length)
+        return ColorMap::Analyze(p, delta_e76, delta_e2000);
+    std::vector<float> colormap(3 * p.n);
+    int clipped = ColorMap::Evaluator(p).FillArcLength(colormap.data());
+    ColorMap::Analysis a = ColorMap::Analyze(p.n, colormap.data(), delta_e76, delta_e2000);
+    a.clipped = clipped;
+    return a;
+}
+
+static void analyze_maps(void* data, int begin, int end)
+{
+    analyze_job* j = static_cast<analyze_job*>(data);
+    for (int i = begin; i < end; i++)
+        j->results[i] = analyze(j->requests[i].get(), j->arc_length);
+}
+
+/* Generate all color maps into one buffer, with a single call unless the
+ * colors are spaced evenly in arc length */
+template<typename T>
+static void generate_all(bool arc_length, const std::vector<ColorMap::Parameters>& parameters,
+        T* colormaps, int* clipped)
+{
+    if (!arc_length) {
+        ColorMap::Generate(parameters.size(), parameters.data(), colormaps, clipped);
+        return;
+    }
+    for (size_t i = 0; i < parameters.size(); i++) {
+        clipped[i] = ColorMap::Evaluator(parameters[i]).FillArcLength(colormaps);
+        colormaps += 3 * parameters[i].n;
+    }
+}
+
+/* Writing of the generated color maps in one format. With several formats,
+ * each one is written by its own thread. */
+static const size_t output_buffer_size = 4 << 20;
+
+struct output_job {
+    int format;
+    std::string filename;       // empty for standard output
+    size_t count;
+    const ColorMap::Parameters* parameters;
+    const unsigned char* colormaps;
+    const float* float_colormaps;
+    bool ok;
+    int error;
+
+    output_job() : format(0), count(0), parameters(NULL), colormaps(NULL), float_colormaps(NULL),
+        ok(true), error(0)
+    {
+    }
+};
+
+static void write_output(output_job* j)
+{
+    FILE* f = stdout;
+    if (!j->filename.empty()) {
+        f = fopen(j->filename.c_str(), "wb");
+        if (!f) {
+            j->ok = false;
+            j->error = errno;
+            return;
+        }
+        // Large writes; the data is only written once, in order
+        setvbuf(f, NULL, _IOFBF, output_buffer_size);
+    }
+    ColorMap::FileWriter writer(f);
+    const unsigned char* colormap = j->colormaps;
+    const float* float_colormap = j->float_colormaps;
+    for (size_t i = 0; j->ok && i < j->count; i++) {
+        int n = j->parameters[i].n;
+        if (j->format == ColorMap::FormatRawRGB32F) {
+            j->ok = ColorMap::ExportRawRGB32F(n, float_colormap, writer);
+            float_colormap += 3 * n;
+        } else {
+            j->ok = ColorMap::Export(ColorMap::Format(j->format), n, colormap, writer);
+            colormap += 3 * n;
+        }
+    }
+    if (f == stdout ? ferror(f) : fclose(f) != 0)
+        j->ok = false;
+    if (!j->ok)
+        j->error = errno;
+}
+
+// The label of a color map in an analysis table: its name or its number
+static std::string map_label(const std::vector<map_request>& requests, size_t i)
+{
+    return requests[i].name.empty() ? std::to_string(i + 1) : requests[i].name;
+}
+
+/* Generate, analyze or sweep the requested color maps and write the results.
+ * Returns the exit status. */
+static int run(const program_options& po, const map_options& mo)
+{
+    ColorMap::SetThreads(po.threads);
+
+    std::vector<map_request> requests;
+    if (po.batch) {
+        if (!read_batch(po.batch, mo, requests))
+            return 1;
+    } else {
+        map_request req;
+        if (!make_request(mo, "", req))
             return 1;
+        requests.push_back(req);
+    }
+
+    if (po.definition) {
+        for (size_t i = 0; i < requests.size(); i++)
+            fputs(ColorMap::ToDefinition(requests[i].get()).c_str(), stdout);
+        return 0;
+    }
+
+    if (po.sweep.size() > 0) {
+        int ranges = po.sweep.size();
+        int points = ColorMap::SweepPoints(ranges, po.sweep.data());
+        if (points < 0) {
+            fprintf(stderr, "Too many sweep points.\n");
+            return 1;
+        }
+        const ColorMap::Parameters& base = requests[0].get();
+        std::vector<ColorMap::SweepResult> results(points);
+        ColorMap::Sweep(base, ranges, po.sweep.data(), po.uniformity, results.data());
+        for (int r = 0; r < ranges; r++)
+            printf("%s,", sweep_names[po.sweep[r].parameter]);
+        printf(po.uniformity ? "clipped,uniformity\n" : "clipped\n");
+        int unclipped = 0;
+        for (int i = 0; i < points; i++) {
+            for (int r = 0; r < ranges; r++) {
+                float value = ColorMap::SweepValue(ranges, po.sweep.data(), i, r);
+                if (sweep_in_degrees(po.sweep[r].parameter))
+                    value *= 180.0 / M_PI;
+                printf("%g,", value);
+            }
+            if (po.uniformity)
+                printf("%d,%g\n", results[i].clipped, results[i].uniformity);
+            else
+                printf("%d\n", results[i].clipped);
+            if (results[i].clipped == 0)
+                unclipped++;
+        }
+        fprintf(stderr, "%d of %d parameter set(s) without clipped colors\n", unclipped, points);
+        return 0;
+    }
+
+    if (po.analyze == 1) {
+        // Analyze the color maps in parallel; each analysis is then sequential
+        analyze_job j;
+        j.requests = requests.data();
+        j.arc_length = po.arc_length;
+        j.results.resize(requests.size());
+        ColorMap::ParallelFor(requests.size(), 1, analyze_maps, &j);
+        printf("map,n,clipped,"
+                "min_delta_e76,max_delta_e76,mean_delta_e76,arc_length76,uniformity76,"
+                "min_delta_e2000,max_delta_e2000,mean_delta_e2000,arc_length2000,uniformity2000,"
+                "min_lightness,max_lightness,lightness_direction,lightness_reversals\n");
+        for (size_t i = 0; i < requests.size(); i++) {
+            const ColorMap::Analysis& a = j.results[i];
+            printf("%s,%d,%d,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%d,%d\n",
+                    map_label(requests, i).c_str(), a.n, a.clipped,
+                    a.min_delta_e76, a.max_delta_e76, a.mean_delta_e76, a.arc_length76, a.uniformity76,
+                    a.min_delta_e2000, a.max_delta_e2000, a.mean_delta_e2000, a.arc_length2000, a.uniformity2000,
+                    a.min_lightness, a.max_lightness, a.lightness_direction, a.lightness_reversals);
+        }
+        return 0;
+    }
+    if (po.analyze == 2) {
+        printf("map,step,delta_e76,delta_e2000,arc_length76,arc_length2000\n");
+        std::vector<float> delta_e76, delta_e2000;
+        for (size_t i = 0; i < requests.size(); i++) {
+            const ColorMap::Parameters& p = requests[i].get();
+            delta_e76.resize(p.n);
+            delta_e2000.resize(p.n);
+            analyze(p, po.arc_length, delta_e76.data(), delta_e2000.data());
+            std::string label = map_label(requests, i);
+            double arc76 = 0.0, arc2000 = 0.0;
+            for (int k = 0; k < p.n - 1; k++) {
+                arc76 += delta_e76[k];
+                arc2000 += delta_e2000[k];
+                printf("%s,%d,%g,%g,%g,%g\n", label.c_str(), k + 1,
+                        delta_e76[k], delta_e2000[k], arc76, arc2000);
+            }
         }
+        return 0;
     }
 
-    if (print_version) {
+    // Generate all color maps into one buffer with a single call
+    std::vector<ColorMap::Parameters> parameters(requests.size());
+    size_t total_n = 0;
+    for (size_t i = 0; i < requests.size(); i++) {
+        parameters[i] = requests[i].get();
+        total_n += parameters[i].n;
+    }
+    std::vector<int> clipped(requests.size());
+    if (po.atlas) {
+        std::vector<std::string> labels(requests.size());
+        std::vector<const char*> names(requests.size());
+        for (size_t i = 0; i < requests.size(); i++) {
+            labels[i] = map_label(requests, i);
+            names[i] = labels[i].c_str();
+        }
+        int width = ColorMap::AtlasWidth(parameters.size(), parameters.data());
+        size_t atlas_size = 3 * size_t(width) * parameters.size();
+        FILE* f = fopen(po.atlas, "wb");
+        if (!f) {
+            fprintf(stderr, "Cannot open %s: %s\n", po.atlas, strerror(errno));
+            return 1;
+        }
+        ColorMap::FileWriter writer(f);
+        bool ok;
+        if (po.format == ColorMap::FormatRawRGB32F) {
+            // Generate float values directly to avoid 8 bit quantization
+            std::vector<float> atlas(atlas_size);
+            ColorMap::GenerateAtlas(parameters.size(), parameters.data(), width, atlas.data(), clipped.data());
+            ok = ColorMap::ExportRawRGB32F(atlas_size / 3, atlas.data(), writer);
+        } else {
+            std::vector<unsigned char> atlas(atlas_size);
+            ColorMap::GenerateAtlas(parameters.size(), parameters.data(), width, atlas.data(), clipped.data());
+            ok = ColorMap::ExportAtlas(ColorMap::Format(po.format), width, parameters.size(), atlas.data(), writer);
+        }
+        if (fclose(f) != 0)
+            ok = false;
+        if (!ok) {
+            fprintf(stderr, "Cannot write %s: %s\n", po.atlas, strerror(errno));
+            return 1;
+        }
+        std::string index_name = std::string(po.atlas) + ".json";
+        f = fopen(index_name.c_str(), "wb");
+        if (!f) {
+            fprintf(stderr, "Cannot open %s: %s\n", index_name.c_str(), strerror(errno));
+            return 1;
+        }
+        ColorMap::FileWriter index_writer(f);
+        ok = ColorMap::ExportAtlasIndex(parameters.size(), names.data(), parameters.data(), width, index_writer);
+        if (fclose(f) != 0)
+            ok = false;
+        if (!ok) {
+            fprintf(stderr, "Cannot write %s: %s\n", index_name.c_str(), strerror(errno));
+            return 1;
+        }
+        for (size_t i = 0; i < requests.size(); i++)
+            fprintf(stderr, "%s: %d color(s) were clipped\n", names[i], clipped[i]);
+        return 0;
+    }
+    if (po.cache && !po.archive) {
+        // Look up all color maps first, and generate only those that are missing
+        FILE* out = stdout;
+        if (po.output) {
+            out = fopen(po.output, "wb");
+            if (!out) {
+                fprintf(stderr, "Cannot open %s: %s\n", po.output, strerror(errno));
+                return 1;
+            }
+        }
+        ColorMap::ResultCache cache(cache_bytes, po.cache);
+        std::vector<std::string> data(requests.size());
+        std::vector<unsigned long long> keys(requests.size());
+        std::vector<size_t> missing;
+        for (size_t i = 0; i < requests.size(); i++) {
+            keys[i] = ColorMap::CacheKey(parameters[i], ColorMap::Format(po.format));
+            if (!cache.Lookup(keys[i], data[i], &clipped[i]))
+                missing.push_back(i);
+        }
+        if (missing.size() > 0) {
+            std::vector<ColorMap::Parameters> missing_parameters(missing.size());
+            std::vector<std::string> missing_data(missing.size());
+            std::vector<int> missing_clipped(missing.size());
+            for (size_t m = 0; m < missing.size(); m++)
+                missing_parameters[m] = parameters[missing[m]];
+            generate_exports(po.format, missing.size(), missing_parameters.data(),
+                    missing_data.data(), missing_clipped.data());
+            for (size_t m = 0; m < missing.size(); m++) {
+                size_t i = missing[m];
+                data[i].swap(missing_data[m]);
+                clipped[i] = missing_clipped[m];
+                cache.Store(keys[i], data[i], clipped[i]);
+            }
+        }
+        bool ok = true;
+        for (size_t i = 0; ok && i < requests.size(); i++)
+            ok = (fwrite(data[i].data(), 1, data[i].size(), out) == data[i].size());
+        if (out == stdout ? ferror(out) : fclose(out) != 0)
+            ok = false;
+        if (!ok) {
+            if (po.output)
+                fprintf(stderr, "Cannot write %s: %s\n", po.output, strerror(errno));
+            else
+                fprintf(stderr, "Cannot write output.\n");
+            return 1;
+        }
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (po.batch)
+                fprintf(stderr, "%s: map %d: ", po.batch, int(i) + 1);
+            fprintf(stderr, "%d color(s) were clipped\n", clipped[i]);
+        }
+        return 0;
+    }
+    std::vector<unsigned char> colormaps;
+    std::vector<float> float_colormaps;
+    if (po.archive || std::find(po.formats.begin(), po.formats.end(), int(ColorMap::FormatRawRGB32F))
+            != po.formats.end()) {
+        // Generate float values directly to avoid 8 bit quantization; the
+        // archive also stores them
+        float_colormaps.resize(3 * total_n);
+        generate_all(po.arc_length, parameters, float_colormaps.data(), clipped.data());
+        if (!po.archive && po.formats.size() > 1) {
+            // Quantize the clamped values for the other formats instead of
+            // generating the color maps a second time; this gives the same
+            // entries as generating them directly
+            colormaps.resize(3 * total_n);
+            for (size_t i = 0; i < colormaps.size(); i++)
+                colormaps[i] = std::round(float_colormaps[i] * 255.0f);
+        }
+    } else {
+        colormaps.resize(3 * total_n);
+        generate_all(po.arc_length, parameters, colormaps.data(), clipped.data());
+    }
+
+    if (po.archive) {
+        // Name unnamed color maps by their number
+        std::vector<const char*> names(requests.size());
+        std::set<std::string> unique_names;
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (requests[i].name.empty())
+                requests[i].name = std::to_string(i + 1);
+            if (!unique_names.insert(requests[i].name).second) {
+                fprintf(stderr, "Duplicate color map name %s.\n", requests[i].name.c_str());
+                return 1;
+            }
+            names[i] = requests[i].name.c_str();
+        }
+        FILE* f = fopen(po.archive, "wb");
+        if (!f) {
+            fprintf(stderr, "Cannot open %s: %s\n", po.archive, strerror(errno));
+            return 1;
+        }
+        ColorMap::FileWriter writer(f);
+        bool ok = ColorMap::WriteArchive(requests.size(), names.data(), parameters.data(), float_colormaps.data(), writer);
+        if (fclose(f) != 0)
+            ok = false;
+        if (!ok) {
+            fprintf(stderr, "Cannot write %s: %s\n", po.archive, strerror(errno));
+            return 1;
+        }
+        for (size_t i = 0; i < requests.size(); i++)
+            fprintf(stderr, "%s: %d color(s) were clipped\n", names[i], clipped[i]);
+        return 0;
+    }
+
+    // Write each format to its own file, named by the format if there are
+    // several, and format them concurrently
+    std::vector<output_job> jobs(po.formats.size());
+    for (size_t k = 0; k < jobs.size(); k++) {
+        output_job& j = jobs[k];
+        j.format = po.formats[k];
+        if (po.output) {
+            j.filename = po.output;
+            if (jobs.size() > 1)
+                j.filename += std::string(".") + format_names[j.format];
+        }
+        j.count = requests.size();
+        j.parameters = parameters.data();
+        j.colormaps = colormaps.data();
+        j.float_colormaps = float_colormaps.data();
+    }
+    if (jobs.size() == 1) {
+        write_output(&jobs[0]);
+    } else {
+        std::vector<std::thread> threads;
+        for (size_t k = 0; k < jobs.size(); k++)
+            threads.push_back(std::thread(write_output, &jobs[k]));
+        for (size_t k = 0; k < threads.size(); k++)
+            threads[k].join();
+    }
+    bool ok = true;
+    for (size_t k = 0; k < jobs.size(); k++) {
+        if (!jobs[k].ok) {
+            if (jobs[k].filename.empty())
+                fprintf(stderr, "Cannot write output.\n");
+            else
+                fprintf(stderr, "Cannot write %s: %s\n", jobs[k].filename.c_str(), strerror(jobs[k].error));
+            ok = false;
+        }
+    }
+    if (!ok)
+        return 1;
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (po.batch)
+            fprintf(stderr, "%s: map %d: ", po.batch, int(i) + 1);
+        fprintf(stderr, "%d color(s) were clipped\n", clipped[i]);
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    program_options po;
+    map_options mo;
+    if (!parse_options(argc, argv, &po, mo))
+        return 1;
+
+    if (po.print_version) {
         printf("gencolormap version 2.1\n"
                 "https://marlam.de/gencolormap\n"
                 "Copyright (C) 2020 Computer Graphics Group, University of Siegen.\n"
@@ -232,13 +1301,61 @@ int main(int argc, char* argv[])
         return 0;
     }
 
-    if (print_help) {
+    if (po.print_help) {
         printf("Usage: %s [option...]\n"
                 "Generates a color map and prints it to standard output.\n"
                 "Prints the number of colors that had to be clipped to standard error.\n"
                 "Common options:\n"
-                "  [-f|--format=csv|json|ppm]          Set output format\n"
+                "  [-f|--format=csv|json|ppm|ppm-binary|raw-rgb8|raw-rgb32f|cmap|png]\n"
+                "                                      Set output format; repeat to write several\n"
+                "                                      formats of the same color maps at once\n"
+                "  [-o|--output=FILE]                  Write to FILE instead of standard output;\n"
+                "                                      with several formats, write each one to\n"
+                "                                      FILE.FORMAT\n"
                 "  [-n|--n=N]                          Set number of colors in the map\n"
+                "  [-B|--batch=FILE]                   Generate one color map per line of FILE;\n"
+                "                                      each line contains color map options,\n"
+                "                                      the options given here are defaults,\n"
+                "                                      or a color map definition\n"
+                "  [--definition]                      Print the definition of each color map,\n"
+                "                                      which reproduces it exactly with any\n"
+                "                                      number of colors, instead of its colors\n"
+                "  [-j|--threads=N]                    Set number of threads (0 = all cores)\n"
+                "  [--archive=FILE]                    Write all color maps to an archive FILE\n"
+                "                                      instead of standard output\n"
+                "  [--name=NAME]                       Set the name of the color map in an archive\n"
+                "                                      or atlas\n"
+                "  [--atlas=FILE]                      Write all color maps as the rows of one\n"
+                "                                      image FILE (format ppm, ppm-binary, png,\n"
+                "                                      raw-rgb8, or raw-rgb32f) with a power of\n"
+                "                                      two width, and an index to FILE.json\n"
+                "  [--sweep=PARAM:FIRST:LAST:STEPS]    Sweep a parameter (option name without\n"
+                "                                      dashes, e.g. hue) over STEPS values and\n"
+                "                                      print a table of the number of clipped\n"
+                "                                      colors instead of the color map; can be\n"
+                "                                      given more than once to sweep a grid\n"
+                "  [--uniformity]                      Add a perceptual uniformity column to\n"
+                "                                      the sweep table (0 is perfectly uniform)\n"
+                "  [--cache=DIR]                       Reuse color maps stored in directory DIR\n"
+                "                                      and store new ones there\n"
+                "  [--arc-length]                      Space the colors evenly in perceptual arc\n"
+                "                                      length (CIELAB distance along the map)\n"
+                "  [--analyze[=steps]]                 Print a table with the CIE76 and CIEDE2000\n"
+                "                                      differences of neighboring colors, their\n"
+                "                                      sums (arc length), uniformity, lightness\n"
+                "                                      monotonicity and clipping per color map,\n"
+                "                                      or the differences of each step\n"
+                "  [--serve[=SOCKET]]                  Read one line of color map options per\n"
+                "                                      request from standard input or from the\n"
+                "                                      Unix socket SOCKET and answer each with\n"
+                "                                      \"OK <clipped> <bytes>\" and the color map,\n"
+                "                                      or with \"ERROR <message>\"; -j sets the\n"
+                "                                      number of worker threads\n"
+                "  [--stats]                           Print the time spent in each stage of\n"
+                "                                      generation and export, and counters of\n"
+                "                                      the work done, to standard error\n"
+                "  [--trace=FILE]                      Write each timed stage as an event to FILE\n"
+                "                                      in the Chrome trace event format\n"
                 "Brewer-like color maps:\n"
                 "  [-t|--type=brewer-sequential]       Generate a sequential color map\n"
                 "  [-t|--type=brewer-diverging]        Generate a diverging color map\n"
@@ -267,6 +1384,8 @@ int main(int argc, char* argv[])
                 "  [-r|--rotations=R]                  Set number of rotations for rainbow maps\n"
                 "  [-T|--temperature=T]                Set start temp. in K for black body maps\n"
                 "  [-R|--temperature-range=TR]         Set range for temperature in K\n"
+                "  [--exact-blackbody]                 Integrate the spectrum for each color\n"
+                "                                      instead of using a precomputed table\n"
                 "  [-V|--hue-values=H0,H1,...]         Set hue values in [0,360] for multi-hue maps\n"
                 "  [-P|--hue-positions=P0,P1,...]      Set hue positions in [0,1] for multi-hue maps\n"
                 "CubeHelix color maps:\n"
@@ -282,258 +1401,111 @@ int main(int argc, char* argv[])
                 "McNames sequential color maps:\n"
                 "  [-t|--type=mcnames]                 Generate a McNames sequential color map\n"
                 "  [-p|--periods=P]                    Set the number of periods in (0, infty)\n"
+                "Distinct qualitative color maps:\n"
+                "  [-t|--type=distinct]                Generate a large distinct qualitative map\n"
+                "  [-h|--hue=H]                        Set hue of first color in [0,360] degrees\n"
+                "  [-L|--lightness-range=LR]           Set lightness range in [0.5,1]\n"
+                "  [-s|--saturation=S]                 Set minimum saturation in [0,1]\n"
                 "Defaults: format=csv, n=256, type=brewer-sequential\n"
                 "https://marlam.de/gencolormap\n", argv[0]);
         return 0;
     }
 
-    if (format < 0) {
+    if (po.formats.empty())
+        po.formats.push_back(ColorMap::FormatCSV);
+    if (std::find(po.formats.begin(), po.formats.end(), -1) != po.formats.end()) {
         fprintf(stderr, "Invalid argument for option -f|--format.\n");
         return 1;
     }
-    if (n < 2) {
-        fprintf(stderr, "Invalid argument for option -n|--n.\n");
+    po.format = po.formats[0];
+    if (po.formats.size() > 1 && !po.output) {
+        fprintf(stderr, "Several formats require option -o|--output.\n");
         return 1;
     }
-    if (type < 0) {
-        fprintf(stderr, "Invalid argument for option -t|--type.\n");
+    if (po.formats.size() > 1 && (po.archive || po.atlas || po.cache || po.serve)) {
+        fprintf(stderr, "Several formats cannot be combined with --archive, --atlas, --cache, or --serve.\n");
         return 1;
     }
-    if (hue < 0.0f) {
-        if (type == brewer_seq)
-            hue = ColorMap::BrewerSequentialDefaultHue;
-        else if (type == brewer_div)
-            hue = ColorMap::BrewerDivergingDefaultHue;
-        else if (type == brewer_qual)
-            hue = ColorMap::BrewerQualitativeDefaultHue;
-        else if (type == puseq_lightness)
-            hue = ColorMap::PUSequentialLightnessDefaultHue;
-        else if (type == puseq_saturation)
-            hue = ColorMap::PUSequentialSaturationDefaultHue;
-        else if (type == puseq_rainbow)
-            hue = ColorMap::PUSequentialRainbowDefaultHue;
-        else if (type == pudiv_lightness)
-            hue = ColorMap::PUDivergingLightnessDefaultHue;
-        else if (type == pudiv_saturation)
-            hue = ColorMap::PUDivergingSaturationDefaultHue;
-        else if (type == puqual_hue)
-            hue = ColorMap::PUQualitativeHueDefaultHue;
-        else if (type == cubehelix)
-            hue = ColorMap::CubeHelixDefaultHue;
-    }
-    if (divergence < 0.0f) {
-        if (type == brewer_div)
-            divergence = ColorMap::BrewerDivergingDefaultDivergence;
-        else if (type == brewer_qual)
-            divergence = ColorMap::BrewerQualitativeDefaultDivergence;
-        else if (type == pudiv_lightness)
-            divergence = ColorMap::PUDivergingLightnessDefaultDivergence;
-        else if (type == pudiv_saturation)
-            divergence = ColorMap::PUDivergingSaturationDefaultDivergence;
-        else if (type == puqual_hue)
-            divergence = ColorMap::PUQualitativeHueDefaultDivergence;
-    }
-    if (contrast < 0.0f) {
-        if (type == brewer_seq)
-            contrast = (n <= 9 ? ColorMap::BrewerSequentialDefaultContrastForSmallN(n)
-                    : ColorMap::BrewerSequentialDefaultContrast);
-        else if (type == brewer_div)
-            contrast = (n <= 9 ? ColorMap::BrewerDivergingDefaultContrastForSmallN(n)
-                    : ColorMap::BrewerDivergingDefaultContrast);
-        else if (type == brewer_qual)
-            contrast = ColorMap::BrewerQualitativeDefaultContrast;
-    }
-    if (saturation < 0.0f) {
-        if (type == brewer_seq)
-            saturation = ColorMap::BrewerSequentialDefaultSaturation;
-        else if (type == brewer_div)
-            saturation = ColorMap::BrewerDivergingDefaultSaturation;
-        else if (type == brewer_qual)
-            saturation = ColorMap::BrewerQualitativeDefaultSaturation;
-        else if (type == puseq_lightness)
-            saturation = ColorMap::PUSequentialLightnessDefaultSaturation;
-        else if (type == puseq_saturation)
-            saturation = ColorMap::PUSequentialSaturationDefaultSaturation;
-        else if (type == puseq_rainbow)
-            saturation = ColorMap::PUSequentialRainbowDefaultSaturation;
-        else if (type == puseq_blackbody)
-            saturation = ColorMap::PUSequentialBlackBodyDefaultSaturation;
-        else if (type == puseq_multihue)
-            saturation = ColorMap::PUSequentialMultiHueDefaultSaturation;
-        else if (type == pudiv_lightness)
-            saturation = ColorMap::PUDivergingLightnessDefaultSaturation;
-        else if (type == pudiv_saturation)
-            saturation = ColorMap::PUDivergingSaturationDefaultSaturation;
-        else if (type == puqual_hue)
-            saturation = ColorMap::PUQualitativeHueDefaultSaturation;
-        else if (type == cubehelix)
-            saturation = ColorMap::CubeHelixDefaultSaturation;
-    }
-    if (saturation_range < 0.0f) {
-        if (type == puseq_lightness)
-            saturation_range = ColorMap::PUSequentialLightnessDefaultSaturationRange;
-        else if (type == puseq_saturation)
-            saturation_range = ColorMap::PUSequentialSaturationDefaultSaturationRange;
-        else if (type == puseq_rainbow)
-            saturation_range = ColorMap::PUSequentialRainbowDefaultSaturationRange;
-        else if (type == puseq_blackbody)
-            saturation_range = ColorMap::PUSequentialBlackBodyDefaultSaturationRange;
-        else if (type == puseq_multihue)
-            saturation_range = ColorMap::PUSequentialMultiHueDefaultSaturationRange;
-        else if (type == pudiv_lightness)
-            saturation_range = ColorMap::PUDivergingLightnessDefaultSaturationRange;
-        else if (type == pudiv_saturation)
-            saturation_range = ColorMap::PUDivergingSaturationDefaultSaturationRange;
-    }
-    if (brightness < 0.0f) {
-        if (type == brewer_seq)
-            brightness = ColorMap::BrewerSequentialDefaultBrightness;
-        else if (type == brewer_div)
-            brightness = ColorMap::BrewerDivergingDefaultBrightness;
-        else if (type == brewer_qual)
-            brightness = ColorMap::BrewerQualitativeDefaultBrightness;
-    }
-    if (warmth < 0.0f) {
-        if (type == brewer_seq)
-            warmth = ColorMap::BrewerSequentialDefaultWarmth;
-        else if (type == brewer_div)
-            warmth = ColorMap::BrewerDivergingDefaultWarmth;
-    }
-    if (lightness < 0.0f) {
-        if (type == puseq_saturation)
-            lightness = ColorMap::PUSequentialSaturationDefaultLightness;
-        else if (type == pudiv_saturation)
-            lightness = ColorMap::PUDivergingSaturationDefaultLightness;
-        else if (type == puqual_hue)
-            lightness = ColorMap::PUQualitativeHueDefaultLightness;
-    }
-    if (lightness_range < 0.0f) {
-        if (type == puseq_lightness)
-            lightness_range = ColorMap::PUSequentialLightnessDefaultLightnessRange;
-        else if (type == puseq_rainbow)
-            lightness_range = ColorMap::PUSequentialRainbowDefaultLightnessRange;
-        else if (type == puseq_blackbody)
-            lightness_range = ColorMap::PUSequentialBlackBodyDefaultLightnessRange;
-        else if (type == puseq_multihue)
-            lightness_range = ColorMap::PUSequentialMultiHueDefaultLightnessRange;
-        else if (type == pudiv_lightness)
-            lightness_range = ColorMap::PUDivergingLightnessDefaultLightnessRange;
-    }
-    if (std::isnan(rotations)) {
-        if (type == puseq_rainbow)
-            rotations = ColorMap::PUSequentialRainbowDefaultRotations;
-        else if (type == cubehelix)
-            rotations = ColorMap::CubeHelixDefaultRotations;
-    }
-    if (temperature < 0.0f) {
-        if (type == puseq_blackbody)
-            temperature = ColorMap::PUSequentialBlackBodyDefaultTemperature;
-    }
-    if (temperature_range < 0.0f) {
-        if (type == puseq_blackbody)
-            temperature_range = ColorMap::PUSequentialBlackBodyDefaultTemperatureRange;
-    }
-    if (gamma < 0.0f) {
-        if (type == cubehelix)
-            gamma = ColorMap::CubeHelixDefaultGamma;
-    }
-    if (hue_values.size() == 0) {
-        if (type == puseq_multihue) {
-            hue_values.resize(ColorMap::PUSequentialMultiHueDefaultHues);
-            for (size_t i = 0; i < hue_values.size(); i++)
-                hue_values[i] = ColorMap::PUSequentialMultiHueDefaultHueValues[i];
-        }
-    }
-    if (hue_positions.size() == 0) {
-        if (type == puseq_multihue) {
-            hue_positions.resize(ColorMap::PUSequentialMultiHueDefaultHues);
-            for (size_t i = 0; i < hue_positions.size(); i++)
-                hue_positions[i] = ColorMap::PUSequentialMultiHueDefaultHuePositions[i];
-        }
-    }
-    if (hue_values.size() != hue_positions.size()) {
-        fprintf(stderr, "Number of hue values and positions do not match.\n");
+    if (po.output && (po.archive || po.atlas || po.sweep.size() > 0 || po.analyze || po.definition
+                || po.serve)) {
+        fprintf(stderr, "Option -o|--output cannot be combined with --archive, --atlas, --sweep, --analyze,\n"
+                "--definition, or --serve.\n");
         return 1;
     }
-    if (!have_color0) {
-        if (type == moreland) {
-            color0[0] = ColorMap::MorelandDefaultR0;
-            color0[1] = ColorMap::MorelandDefaultG0;
-            color0[2] = ColorMap::MorelandDefaultB0;
-        }
-    }
-    if (!have_color1) {
-        if (type == moreland) {
-            color1[0] = ColorMap::MorelandDefaultR1;
-            color1[1] = ColorMap::MorelandDefaultG1;
-            color1[2] = ColorMap::MorelandDefaultB1;
-        }
-    }
-    if (std::isnan(periods)) {
-        if (type == mcnames)
-            periods = ColorMap::McNamesDefaultPeriods;
-    }
-
-    std::vector<unsigned char> colormap(3 * n);
-    int clipped;
-    switch (type) {
-    case brewer_seq:
-        clipped = ColorMap::BrewerSequential(n, &(colormap[0]), hue, contrast, saturation, brightness, warmth);
-        break;
-    case brewer_div:
-        clipped = ColorMap::BrewerDiverging(n, &(colormap[0]), hue, divergence, contrast, saturation, brightness, warmth);
-        break;
-    case brewer_qual:
-        clipped = ColorMap::BrewerQualitative(n, &(colormap[0]), hue, divergence, contrast, saturation, brightness);
-        break;
-    case puseq_lightness:
-        clipped = ColorMap::PUSequentialLightness(n, &(colormap[0]), lightness_range, saturation_range, saturation, hue);
-        break;
-    case puseq_saturation:
-        clipped = ColorMap::PUSequentialSaturation(n, &(colormap[0]), saturation_range, lightness, saturation, hue);
-        break;
-    case puseq_rainbow:
-        clipped = ColorMap::PUSequentialRainbow(n, &(colormap[0]), lightness_range, saturation_range, hue, rotations, saturation);
-        break;
-    case puseq_blackbody:
-        clipped = ColorMap::PUSequentialBlackBody(n, &(colormap[0]), temperature, temperature_range, lightness_range, saturation_range, saturation);
-        break;
-    case puseq_multihue:
-        clipped = ColorMap::PUSequentialMultiHue(n, &(colormap[0]), lightness_range, saturation_range, saturation,
-                hue_values.size(), hue_values.data(), hue_positions.data());
-        break;
-    case pudiv_lightness:
-        clipped = ColorMap::PUDivergingLightness(n, &(colormap[0]), lightness_range, saturation_range, saturation, hue, divergence);
-        break;
-    case pudiv_saturation:
-        clipped = ColorMap::PUDivergingSaturation(n, &(colormap[0]), saturation_range, lightness, saturation, hue, divergence);
-        break;
-    case puqual_hue:
-        clipped = ColorMap::PUQualitativeHue(n, &(colormap[0]), hue, divergence, lightness, saturation);
-        break;
-    case cubehelix:
-        clipped = ColorMap::CubeHelix(n, &(colormap[0]), hue, rotations, saturation, gamma);
-        break;
-    case moreland:
-        clipped = ColorMap::Moreland(n, &(colormap[0]),
-                color0[0], color0[1], color0[2],
-                color1[0], color1[1], color1[2]);
-        break;
-    case mcnames:
-        clipped = ColorMap::McNames(n, &(colormap[0]), periods);
-        break;
-    }
-
-    std::string output;
-    if (format == csv) {
-        output = ColorMap::ToCSV(n, colormap.data());
-    } else if (format == json) {
-        output = ColorMap::ToJSON(n, colormap.data());
-    } else {
-        output = ColorMap::ToPPM(n, colormap.data());
-    }
-    fputs(output.c_str(), stdout);
-    fprintf(stderr, "%d color(s) were clipped\n", clipped);
 
-    return 0;
+    if (po.threads < 0) {
+        fprintf(stderr, "Invalid argument for option -j|--threads.\n");
+        return 1;
+    }
+    if (po.sweep_error || (po.uniformity && po.sweep.empty())) {
+        fprintf(stderr, "Invalid argument for option --sweep.\n");
+        return 1;
+    }
+    if (po.sweep.size() > 0 && (po.batch || po.archive)) {
+        fprintf(stderr, "Option --sweep cannot be combined with --batch or --archive.\n");
+        return 1;
+    }
+    if (po.cache && access(po.cache, R_OK | W_OK | X_OK) != 0) {
+        fprintf(stderr, "Cannot use cache directory %s: %s\n", po.cache, strerror(errno));
+        return 1;
+    }
+    if (po.analyze < 0) {
+        fprintf(stderr, "Invalid argument for option --analyze.\n");
+        return 1;
+    }
+    if (po.analyze && (po.archive || po.sweep.size() > 0)) {
+        fprintf(stderr, "Option --analyze cannot be combined with --archive or --sweep.\n");
+        return 1;
+    }
+    if (po.arc_length && (po.archive || po.sweep.size() > 0 || po.cache || po.serve)) {
+        fprintf(stderr, "Option --arc-length cannot be combined with --archive, --sweep, --cache, or --serve.\n");
+        return 1;
+    }
+    if (po.atlas && (po.format == ColorMap::FormatCSV || po.format == ColorMap::FormatJSON
+                || po.format == ColorMap::FormatCMap)) {
+        fprintf(stderr, "Option --atlas requires an image format.\n");
+        return 1;
+    }
+    if (po.atlas && (po.archive || po.sweep.size() > 0 || po.analyze || po.arc_length || po.cache || po.serve)) {
+        fprintf(stderr, "Option --atlas cannot be combined with --archive, --sweep, --analyze, --arc-length,\n"
+                "--cache, or --serve.\n");
+        return 1;
+    }
+    if (po.definition && (po.archive || po.atlas || po.sweep.size() > 0 || po.analyze || po.arc_length
+                || po.cache || po.serve)) {
+        fprintf(stderr, "Option --definition cannot be combined with --archive, --atlas, --sweep, --analyze,\n"
+                "--arc-length, --cache, or --serve.\n");
+        return 1;
+    }
+    if (po.serve && (po.analyze || po.batch || po.archive || po.sweep.size() > 0)) {
+        fprintf(stderr, "Option --serve cannot be combined with --batch, --archive, --sweep, or --analyze.\n");
+        return 1;
+    }
+    ColorMap::SetExactBlackBody(po.exact_blackbody);
+    if (po.stats || po.trace) {
+        if (po.trace)
+            ColorMap::SetTracing(true);
+        else
+            ColorMap::SetInstrumentation(true);
+        if (!ColorMap::Instrumentation()) {
+            fprintf(stderr, "Options --stats and --trace are not available in this build.\n");
+            return 1;
+        }
+        ColorMap::ResetStatistics();
+    }
+    int status = (po.serve ? (serve(po, mo) ? 0 : 1) : run(po, mo));
+    if (po.stats)
+        fputs(ColorMap::StatisticsToText(ColorMap::GetStatistics()).c_str(), stderr);
+    if (po.trace) {
+        std::string json = ColorMap::TraceToJSON();
+        FILE* f = fopen(po.trace, "wb");
+        bool ok = (f && fwrite(json.data(), 1, json.size(), f) == json.size());
+        if (f && fclose(f) != 0)
+            ok = false;
+        if (!ok) {
+            fprintf(stderr, "Cannot write %s: %s\n", po.trace, strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
 }
@@ -25,6 +25,9 @@
 #ifndef COLORMAP_HPP
 #define COLORMAP_HPP
 
+#include <cstddef>
+#include <vector>
+
 /* Generate color maps for scientific visualization purposes.
  *
  * Usage:
@@ -35,12 +38,24 @@
  *   The return value is always the number of colors that had to be clipped
  *   to fit into sRGB; you want to keep that number low by adjusting parameters.
  *
- * All colors are represented as unsigned char sRGB triplets, with each value in
- * [0,255].
+ * All colors are represented as sRGB triplets. The generator functions are
+ * available for several component types:
+ * - unsigned char, with values in [0,255]
+ * - unsigned short, with values in [0,65535]
+ * - float, with values in [0,1]
+ * - ColorMap::half (IEEE 754 binary16), with values in [0,1]
+ * With the floating point types, the colors are not quantized. A color counts
+ * as clipped if a component had to be changed to fit into the value range
+ * (after rounding, for the integer types).
  */
 
 namespace ColorMap {
 
+// A 16 bit floating point value (IEEE 754 binary16), e.g. for GPU textures
+struct half {
+    unsigned short bits;
+};
+
 /*
  * Brewer-like color maps, as described in
  * M. Wijffelaars, R. Vliegen, J.J. van Wijk, E.-J. van der Linden. Generating
@@ -50,14 +65,15 @@ namespace ColorMap {
 
 // Create a sequential color map with n colors of the given hue in [0,2*PI].
 
-const float BrewerSequentialDefaultHue = 4.18879020479f; // 240 deg
-const float BrewerSequentialDefaultContrast = 0.88f;
+constexpr float BrewerSequentialDefaultHue = 4.18879020479f; // 240 deg
+constexpr float BrewerSequentialDefaultContrast = 0.88f;
 float BrewerSequentialDefaultContrastForSmallN(int n); // only for discrete color maps, i.e. n <= 9
-const float BrewerSequentialDefaultSaturation = 0.6f;
-const float BrewerSequentialDefaultBrightness = 0.75f;
-const float BrewerSequentialDefaultWarmth = 0.15f;
+constexpr float BrewerSequentialDefaultSaturation = 0.6f;
+constexpr float BrewerSequentialDefaultBrightness = 0.75f;
+constexpr float BrewerSequentialDefaultWarmth = 0.15f;
 
-int BrewerSequential(int n, unsigned char* srgb_colormap,
+template<typename T>
+int BrewerSequential(int n, T* srgb_colormap,
         float hue = BrewerSequentialDefaultHue,
         float contrast = BrewerSequentialDefaultContrast,
         float saturation = BrewerSequentialDefaultSaturation,
@@ -69,15 +85,16 @@ int BrewerSequential(int n, unsigned char* srgb_colormap,
 // by divergence (in [0,2*PI]) to that hue, and they will meet in the middle at
 // a neutral color.
 
-const float BrewerDivergingDefaultHue = 4.18879020479f; // 240 deg
-const float BrewerDivergingDefaultDivergence = 4.18879020479f; // 240 deg = 2/3 * 2PI
-const float BrewerDivergingDefaultContrast = 0.88f;
+constexpr float BrewerDivergingDefaultHue = 4.18879020479f; // 240 deg
+constexpr float BrewerDivergingDefaultDivergence = 4.18879020479f; // 240 deg = 2/3 * 2PI
+constexpr float BrewerDivergingDefaultContrast = 0.88f;
 float BrewerDivergingDefaultContrastForSmallN(int n); // only for discrete color maps, i.e. n <= 9
-const float BrewerDivergingDefaultSaturation = 0.6f;
-const float BrewerDivergingDefaultBrightness = 0.75f;
-const float BrewerDivergingDefaultWarmth = 0.15f;
+constexpr float BrewerDivergingDefaultSaturation = 0.6f;
+constexpr float BrewerDivergingDefaultBrightness = 0.75f;
+constexpr float BrewerDivergingDefaultWarmth = 0.15f;
 
-int BrewerDiverging(int n, unsigned char* srgb_colormap,
+template<typename T>
+int BrewerDiverging(int n, T* srgb_colormap,
         float hue = BrewerDivergingDefaultHue,
         float divergence = BrewerDivergingDefaultDivergence,
         float contrast = BrewerDivergingDefaultContrast,
@@ -90,13 +107,14 @@ int BrewerDiverging(int n, unsigned char* srgb_colormap,
 // the first color, and the parameter divergence defines the hue range starting
 // from that hue that can be used for the colors.
 
-const float BrewerQualitativeDefaultHue = 0.0f;
-const float BrewerQualitativeDefaultDivergence = 4.18879020479f; // 2/3 * 2PI
-const float BrewerQualitativeDefaultContrast = 0.5f;
-const float BrewerQualitativeDefaultSaturation = 0.5f;
-const float BrewerQualitativeDefaultBrightness = 0.8f;
+constexpr float BrewerQualitativeDefaultHue = 0.0f;
+constexpr float BrewerQualitativeDefaultDivergence = 4.18879020479f; // 2/3 * 2PI
+constexpr float BrewerQualitativeDefaultContrast = 0.5f;
+constexpr float BrewerQualitativeDefaultSaturation = 0.5f;
+constexpr float BrewerQualitativeDefaultBrightness = 0.8f;
 
-int BrewerQualitative(int n, unsigned char* colormap,
+template<typename T>
+int BrewerQualitative(int n, T* colormap,
         float hue = BrewerQualitativeDefaultHue,
         float divergence = BrewerQualitativeDefaultDivergence,
         float contrast = BrewerQualitativeDefaultContrast,
@@ -122,12 +140,13 @@ int BrewerQualitative(int n, unsigned char* colormap,
 
 // Varying lightness
 
-const float PUSequentialLightnessDefaultLightnessRange = 0.95f;
-const float PUSequentialLightnessDefaultSaturationRange = 0.95f;
-const float PUSequentialLightnessDefaultSaturation = 0.45f;
-const float PUSequentialLightnessDefaultHue = 0.349065850399f; // 20 deg
+constexpr float PUSequentialLightnessDefaultLightnessRange = 0.95f;
+constexpr float PUSequentialLightnessDefaultSaturationRange = 0.95f;
+constexpr float PUSequentialLightnessDefaultSaturation = 0.45f;
+constexpr float PUSequentialLightnessDefaultHue = 0.349065850399f; // 20 deg
 
-int PUSequentialLightness(int n, unsigned char* colormap,
+template<typename T>
+int PUSequentialLightness(int n, T* colormap,
         float lightness_range = PUSequentialLightnessDefaultLightnessRange,
         float saturation_range = PUSequentialLightnessDefaultSaturationRange,
         float saturation = PUSequentialLightnessDefaultSaturation,
@@ -135,12 +154,13 @@ int PUSequentialLightness(int n, unsigned char* colormap,
 
 // Varying saturation
 
-const float PUSequentialSaturationDefaultSaturationRange = PUSequentialLightnessDefaultSaturationRange;
-const float PUSequentialSaturationDefaultLightness = 0.5f;
-const float PUSequentialSaturationDefaultSaturation = PUSequentialLightnessDefaultSaturation;
-const float PUSequentialSaturationDefaultHue = 0.349065850399f; // 20 deg
+constexpr float PUSequentialSaturationDefaultSaturationRange = PUSequentialLightnessDefaultSaturationRange;
+constexpr float PUSequentialSaturationDefaultLightness = 0.5f;
+constexpr float PUSequentialSaturationDefaultSaturation = PUSequentialLightnessDefaultSaturation;
+constexpr float PUSequentialSaturationDefaultHue = 0.349065850399f; // 20 deg
 
-int PUSequentialSaturation(int n, unsigned char* colormap,
+template<typename T>
+int PUSequentialSaturation(int n, T* colormap,
         float saturation_range = PUSequentialSaturationDefaultSaturationRange,
         float lightness = PUSequentialSaturationDefaultLightness,
         float saturation = PUSequentialSaturationDefaultSaturation,
@@ -148,13 +168,14 @@ int PUSequentialSaturation(int n, unsigned char* colormap,
 
 // Varying hue (through all colors, rainbow-like)
 
-const float PUSequentialRainbowDefaultLightnessRange = PUSequentialLightnessDefaultLightnessRange;
-const float PUSequentialRainbowDefaultSaturationRange = PUSequentialLightnessDefaultSaturationRange;
-const float PUSequentialRainbowDefaultHue = 0.0f;
-const float PUSequentialRainbowDefaultRotations = -1.5f;
-const float PUSequentialRainbowDefaultSaturation = 1.1f;
+constexpr float PUSequentialRainbowDefaultLightnessRange = PUSequentialLightnessDefaultLightnessRange;
+constexpr float PUSequentialRainbowDefaultSaturationRange = PUSequentialLightnessDefaultSaturationRange;
+constexpr float PUSequentialRainbowDefaultHue = 0.0f;
+constexpr float PUSequentialRainbowDefaultRotations = -1.5f;
+constexpr float PUSequentialRainbowDefaultSaturation = 1.1f;
 
-int PUSequentialRainbow(int n, unsigned char* colormap,
+template<typename T>
+int PUSequentialRainbow(int n, T* colormap,
         float lightness_range = PUSequentialRainbowDefaultLightnessRange,
         float saturation_range = PUSequentialRainbowDefaultSaturationRange,
         float hue = PUSequentialRainbowDefaultHue,
@@ -166,28 +187,37 @@ int PUSequentialRainbow(int n, unsigned char* colormap,
 // The defaults are chosen so that we start at red and arrive at the D65 white
 // point (6500 K), thus excluding the blue colors that occur at higher
 // temperatures.
-const float PUSequentialBlackBodyDefaultTemperature = 250.0f;
-const float PUSequentialBlackBodyDefaultTemperatureRange = 6250.0f;
-const float PUSequentialBlackBodyDefaultLightnessRange = PUSequentialLightnessDefaultLightnessRange;
-const float PUSequentialBlackBodyDefaultSaturationRange = PUSequentialLightnessDefaultSaturationRange;
-const float PUSequentialBlackBodyDefaultSaturation = 1.4f;
-
-int PUSequentialBlackBody(int n, unsigned char* colormap,
+constexpr float PUSequentialBlackBodyDefaultTemperature = 250.0f;
+constexpr float PUSequentialBlackBodyDefaultTemperatureRange = 6250.0f;
+constexpr float PUSequentialBlackBodyDefaultLightnessRange = PUSequentialLightnessDefaultLightnessRange;
+constexpr float PUSequentialBlackBodyDefaultSaturationRange = PUSequentialLightnessDefaultSaturationRange;
+constexpr float PUSequentialBlackBodyDefaultSaturation = 1.4f;
+
+template<typename T>
+int PUSequentialBlackBody(int n, T* colormap,
         float temperature = PUSequentialBlackBodyDefaultTemperature,
         float temperature_range = PUSequentialBlackBodyDefaultTemperatureRange,
         float lightness_range = PUSequentialBlackBodyDefaultLightnessRange,
         float saturation_range = PUSequentialBlackBodyDefaultSaturationRange,
         float saturation = PUSequentialBlackBodyDefaultSaturation);
 
+// By default, black body hues for temperatures in [250,100000] K are computed
+// from a table of precomputed chromaticities that is built on first use; the
+// hue error is below 0.0035 degrees. For validation, the exact integration
+// over the spectrum can be enabled for every color, which is much slower.
+void SetExactBlackBody(bool exact);
+bool ExactBlackBody();
+
 // Varying hue (user definable)
-const float PUSequentialMultiHueDefaultLightnessRange = PUSequentialLightnessDefaultLightnessRange;
-const float PUSequentialMultiHueDefaultSaturationRange = PUSequentialSaturationDefaultSaturationRange;
-const float PUSequentialMultiHueDefaultSaturation = 0.38f;
+constexpr float PUSequentialMultiHueDefaultLightnessRange = PUSequentialLightnessDefaultLightnessRange;
+constexpr float PUSequentialMultiHueDefaultSaturationRange = PUSequentialSaturationDefaultSaturationRange;
+constexpr float PUSequentialMultiHueDefaultSaturation = 0.38f;
 const int PUSequentialMultiHueDefaultHues = 2; // number of hues defined in the following lists
-const float PUSequentialMultiHueDefaultHueValues[] = { 0.0f, 1.0471975512f }; // hues values in radians in [0,2pi]
-const float PUSequentialMultiHueDefaultHuePositions[] = { 0.25f, 0.75f }; // hue positions in [0,1] sorted in ascending order
+constexpr float PUSequentialMultiHueDefaultHueValues[] = { 0.0f, 1.0471975512f }; // hues values in radians in [0,2pi]
+constexpr float PUSequentialMultiHueDefaultHuePositions[] = { 0.25f, 0.75f }; // hue positions in [0,1] sorted in ascending order
 
-int PUSequentialMultiHue(int n, unsigned char* colormap,
+template<typename T>
+int PUSequentialMultiHue(int n, T* colormap,
         float lightness_range = PUSequentialMultiHueDefaultLightnessRange,
         float saturation_range = PUSequentialMultiHueDefaultSaturationRange,
         float saturation = PUSequentialMultiHueDefaultSaturation,
@@ -199,13 +229,14 @@ int PUSequentialMultiHue(int n, unsigned char* colormap,
 
 // Varying lightness
 
-const float PUDivergingLightnessDefaultLightnessRange = PUSequentialLightnessDefaultLightnessRange;
-const float PUDivergingLightnessDefaultSaturationRange = PUSequentialLightnessDefaultSaturationRange;
-const float PUDivergingLightnessDefaultSaturation = PUSequentialLightnessDefaultSaturation;
-const float PUDivergingLightnessDefaultHue = 0.349065850399f; // 20 deg
-const float PUDivergingLightnessDefaultDivergence = 4.18879020479f; // 2/3 * 2PI
+constexpr float PUDivergingLightnessDefaultLightnessRange = PUSequentialLightnessDefaultLightnessRange;
+constexpr float PUDivergingLightnessDefaultSaturationRange = PUSequentialLightnessDefaultSaturationRange;
+constexpr float PUDivergingLightnessDefaultSaturation = PUSequentialLightnessDefaultSaturation;
+constexpr float PUDivergingLightnessDefaultHue = 0.349065850399f; // 20 deg
+constexpr float PUDivergingLightnessDefaultDivergence = 4.18879020479f; // 2/3 * 2PI
 
-int PUDivergingLightness(int n, unsigned char* colormap,
+template<typename T>
+int PUDivergingLightness(int n, T* colormap,
         float lightness_range = PUDivergingLightnessDefaultLightnessRange,
         float saturation_range = PUDivergingLightnessDefaultSaturationRange,
         float saturation = PUDivergingLightnessDefaultSaturation,
@@ -214,13 +245,14 @@ int PUDivergingLightness(int n, unsigned char* colormap,
 
 // Varying saturation
 
-const float PUDivergingSaturationDefaultSaturationRange = PUSequentialSaturationDefaultSaturationRange;
-const float PUDivergingSaturationDefaultLightness = 0.5f;
-const float PUDivergingSaturationDefaultSaturation = 0.45f;
-const float PUDivergingSaturationDefaultHue = 0.349065850399f; // 20 deg
-const float PUDivergingSaturationDefaultDivergence = 4.18879020479f; // 2/3 * 2PI
+constexpr float PUDivergingSaturationDefaultSaturationRange = PUSequentialSaturationDefaultSaturationRange;
+constexpr float PUDivergingSaturationDefaultLightness = 0.5f;
+constexpr float PUDivergingSaturationDefaultSaturation = 0.45f;
+constexpr float PUDivergingSaturationDefaultHue = 0.349065850399f; // 20 deg
+constexpr float PUDivergingSaturationDefaultDivergence = 4.18879020479f; // 2/3 * 2PI
 
-int PUDivergingSaturation(int n, unsigned char* colormap,
+template<typename T>
+int PUDivergingSaturation(int n, T* colormap,
         float saturation_range = PUSequentialSaturationDefaultSaturationRange,
         float lightness = PUDivergingSaturationDefaultLightness,
         float saturation = PUDivergingSaturationDefaultSaturation,
@@ -229,12 +261,13 @@ int PUDivergingSaturation(int n, unsigned char* colormap,
 
 /* Qualitative perceptually uniform maps */
 
-const float PUQualitativeHueDefaultHue = 0.0f;
-const float PUQualitativeHueDefaultDivergence = 4.18879020479f; // 2/3 * 2PI
-const float PUQualitativeHueDefaultLightness = 0.55f;
-const float PUQualitativeHueDefaultSaturation = 0.22f;
+constexpr float PUQualitativeHueDefaultHue = 0.0f;
+constexpr float PUQualitativeHueDefaultDivergence = 4.18879020479f; // 2/3 * 2PI
+constexpr float PUQualitativeHueDefaultLightness = 0.55f;
+constexpr float PUQualitativeHueDefaultSaturation = 0.22f;
 
-int PUQualitativeHue(int n, unsigned char* colormap,
+template<typename T>
+int PUQualitativeHue(int n, T* colormap,
         float hue = PUQualitativeHueDefaultHue,
         float divergence = PUQualitativeHueDefaultDivergence,
         float lightness = PUQualitativeHueDefaultLightness,
@@ -253,12 +286,13 @@ int PUQualitativeHue(int n, unsigned char* colormap,
 // of colors in the sRGB space. The gamma parameter sets optional gamma correction.
 // The return value is the number of colors that had to be clipped.
 
-const float CubeHelixDefaultHue = 0.523598775598f; // 1/12 * 2PI
-const float CubeHelixDefaultRotations = -1.5f;
-const float CubeHelixDefaultSaturation = 1.2f;
-const float CubeHelixDefaultGamma = 1.0f;
+constexpr float CubeHelixDefaultHue = 0.523598775598f; // 1/12 * 2PI
+constexpr float CubeHelixDefaultRotations = -1.5f;
+constexpr float CubeHelixDefaultSaturation = 1.2f;
+constexpr float CubeHelixDefaultGamma = 1.0f;
 
-int CubeHelix(int n, unsigned char* colormap,
+template<typename T>
+int CubeHelix(int n, T* colormap,
         float hue = CubeHelixDefaultHue,
         float rotations = CubeHelixDefaultRotations,
         float saturation = CubeHelixDefaultSaturation,
@@ -273,14 +307,15 @@ int CubeHelix(int n, unsigned char* colormap,
 // Create a Moreland colormap with n colors. Specify the two endpoints
 // of the colormap as sRGB colors; all intermediate colors will be generated.
 
-const unsigned char MorelandDefaultR0 = 180;
-const unsigned char MorelandDefaultG0 = 4;
-const unsigned char MorelandDefaultB0 = 38;
-const unsigned char MorelandDefaultR1 = 59;
-const unsigned char MorelandDefaultG1 = 76;
-const unsigned char MorelandDefaultB1 = 192;
+constexpr unsigned char MorelandDefaultR0 = 180;
+constexpr unsigned char MorelandDefaultG0 = 4;
+constexpr unsigned char MorelandDefaultB0 = 38;
+constexpr unsigned char MorelandDefaultR1 = 59;
+constexpr unsigned char MorelandDefaultG1 = 76;
+constexpr unsigned char MorelandDefaultB1 = 192;
 
-int Moreland(int n, unsigned char* colormap,
+template<typename T>
+int Moreland(int n, T* colormap,
         unsigned char sr0 = MorelandDefaultR0,
         unsigned char sg0 = MorelandDefaultG0,
         unsigned char sb0 = MorelandDefaultB0,
@@ -299,11 +334,267 @@ int Moreland(int n, unsigned char* colormap,
 // Create a McNames colormap with n colors. Specify the number of
 // periods.
 
-const float McNamesDefaultPeriods = 2.0f;
+constexpr float McNamesDefaultPeriods = 2.0f;
 
-int McNames(int n, unsigned char* colormap,
+template<typename T>
+int McNames(int n, T* colormap,
         float periods = McNamesDefaultPeriods);
 
+/*
+ * Distinct qualitative color maps, for large numbers of categories, e.g. the
+ * labels of a segmentation. The colors are chosen from a lattice in the sRGB
+ * cube so that each new color is as far as possible from all previous colors
+ * in CIELAB (farthest point sampling). Generating n colors takes O(n log n)
+ * time. For n <= 4096, a palette with fewer colors is a prefix of one with
+ * more colors. Each color is distinct in 8 bit sRGB unless n exceeds the
+ * number of available colors, in which case the colors repeat.
+ */
+
+// Create a distinct qualitative colormap with n colors. The first color is the
+// most saturated color in the direction of the given hue (in [0,2*PI]). The
+// CIELAB lightness of all colors is in [100*(1-lightness_range),
+// 100*lightness_range], and their chroma is at least 50*saturation.
+
+constexpr float DistinctDefaultHue = 0.0f;
+constexpr float DistinctDefaultLightnessRange = 0.85f;
+constexpr float DistinctDefaultSaturation = 0.2f;
+
+template<typename T>
+int Distinct(int n, T* colormap,
+        float hue = DistinctDefaultHue,
+        float lightness_range = DistinctDefaultLightnessRange,
+        float saturation = DistinctDefaultSaturation);
+
+/*
+ * Color space conversion.
+ *
+ * Convert n sRGB colors with components in [0,1] to CIELAB with the D65 white
+ * point, using the same conversions as the generator functions. This is useful
+ * to analyze the perceptual properties of a color map. Both arrays hold n
+ * triplets; they may be the same array.
+ */
+
+void SRGBToLAB(int n, const float* srgb, float* lab);
+
+/*
+ * Parallel generation.
+ *
+ * By default, all functions run on the calling thread. SetThreads() sets up a
+ * global pool of worker threads that the generator functions then use for large
+ * color maps. A value of 0 means one thread per processor core, and 1 disables
+ * the pool again. Do not call SetThreads() while color maps are generated.
+ * If the pool is busy, for example because color maps are generated from
+ * several threads at the same time, the remaining work runs on the calling
+ * thread, so the results do not depend on the number of threads.
+ */
+
+void SetThreads(int threads);
+int Threads();
+
+// Thread pools can also be created explicitly, e.g. so that independent parts
+// of a program do not share the global pool (see Context in context.hpp). A
+// value of 0 means one thread per processor core; a pool with 1 thread runs
+// everything on the calling thread. UseThreadPool() makes the calling thread
+// use the given pool instead of the global pool, and NULL selects the global
+// pool again. It returns the previously selected pool. Do not destroy a pool
+// while it is in use.
+
+class ThreadPool;
+
+ThreadPool* CreateThreadPool(int threads);
+void DestroyThreadPool(ThreadPool* pool);
+int ThreadPoolThreads(const ThreadPool* pool);
+ThreadPool* UseThreadPool(ThreadPool* pool);
+
+// Split the range [0,n) into chunks of at least grain elements and call
+// func(data, begin, end) for each chunk, in parallel on the pool of the
+// calling thread or the global pool if it is enabled. Returns when all
+// chunks are done.
+
+void ParallelFor(int n, int grain, void (*func)(void* data, int begin, int end), void* data);
+
+/*
+ * Vectorized conversion.
+ *
+ * The generator functions convert their colors to sRGB in blocks, using vector
+ * instructions where available. The results are identical to those of the
+ * per-color conversion, which can be enabled with SetVectorized(false) as a
+ * reference. Do not call SetVectorized() while color maps are generated.
+ */
+
+void SetVectorized(bool enabled);
+bool Vectorized();
+
+/*
+ * Fast sRGB quantization.
+ *
+ * For 8 bit output, the vectorized conversion replaces the sRGB transfer
+ * function by a table of the linear RGB values at which the quantized result
+ * changes. This gives exactly the same results as the transfer function; use
+ * SetFastSRGB(false) to compare. CheckFastSRGB() compares both for every float
+ * in [-2,2], which takes about half a minute, and returns the number of mismatches,
+ * or -1 if the table could not be built and the fast conversion is never used.
+ * Do not call SetFastSRGB() while color maps are generated.
+ */
+
+void SetFastSRGB(bool enabled);
+bool FastSRGB();
+long long CheckFastSRGB();
+
+/*
+ * Cache statistics.
+ *
+ * The Brewer-like color maps need the most saturated sRGB color for each hue
+ * they use. Each thread caches these colors, so that generating color maps
+ * with the same hues again is cheaper. The statistics count the cache hits and
+ * misses of all threads since the last reset, for profiling purposes.
+ */
+
+void GetSaturationCacheStatistics(unsigned long long* hits, unsigned long long* misses);
+void ResetSaturationCacheStatistics();
+
+/*
+ * Generic interface to all of the above.
+ *
+ * A Parameters record describes one color map of any type. This allows to
+ * handle color maps without knowing their type, and to generate many color
+ * maps with a single call.
+ */
+
+enum Type {
+    TypeBrewerSequential,
+    TypeBrewerDiverging,
+    TypeBrewerQualitative,
+    TypePUSequentialLightness,
+    TypePUSequentialSaturation,
+    TypePUSequentialRainbow,
+    TypePUSequentialBlackBody,
+    TypePUSequentialMultiHue,
+    TypePUDivergingLightness,
+    TypePUDivergingSaturation,
+    TypePUQualitativeHue,
+    TypeCubeHelix,
+    TypeMoreland,
+    TypeMcNames,
+    TypeDistinct
+};
+
+// The parameters of a color map. Each type uses only the fields that correspond
+// to the arguments of its function above; the remaining fields are ignored.
+// The constructor sets the defaults for the given type and number of colors
+// (which for the Brewer-like maps include the contrast for small n), so only
+// the fields that should differ from the defaults need to be changed.
+// The hue lists for PUSequentialMultiHue are not copied; they must remain
+// valid as long as the record is used.
+
+struct Parameters {
+    Type type;
+    int n;
+    float hue;
+    float divergence;
+    float contrast;
+    float saturation;
+    float saturation_range;
+    float brightness;
+    float warmth;
+    float lightness;
+    float lightness_range;
+    float rotations;
+    float temperature;
+    float temperature_range;
+    int hues;
+    const float* hue_values;
+    const float* hue_positions;
+    float gamma;
+    unsigned char color0[3];
+    unsigned char color1[3];
+    float periods;
+
+    Parameters(Type type = TypeBrewerSequential, int n = 256);
+};
+
+// Generate the color map described by the parameters. The colormap must have
+// room for parameters.n colors. Returns the number of clipped colors.
+
+template<typename T>
+int Generate(const Parameters& parameters, T* colormap);
+
+// Generate count color maps into one contiguous buffer, which must have room
+// for the sum of all parameters[i].n colors. The maps are stored one after
+// the other in the order of the parameter records. If clipped is not NULL,
+// the number of clipped colors of map i is stored in clipped[i].
+// Returns the total number of clipped colors.
+
+template<typename T>
+int Generate(int count, const Parameters* parameters, T* colormaps, int* clipped = NULL);
+
+// Compute a 64 bit FNV-1a hash of the type, the number of colors, and the
+// fields that the type uses, including the contents of the hue lists. Records
+// that describe the same color map have the same hash regardless of the
+// ignored fields. Global settings such as SetExactBlackBody() are not part of
+// the hash.
+
+unsigned long long Hash(const Parameters& parameters);
+
+/*
+ * Evaluators.
+ *
+ * An Evaluator computes the colors of the color map described by a Parameters
+ * record at arbitrary positions t in [0,1], e.g. to pick a few colors or to
+ * resample a continuous map, without generating all n colors. The control
+ * points of the color map are computed once when the evaluator is created,
+ * and each color then takes constant time.
+ *
+ * Entry i of a generated color map with n colors is the color at
+ * t = (i + 0.5) / n, except for the diverging maps: a discrete Brewer-like
+ * diverging map with odd n has an extra neutral color in the middle, and the
+ * PU diverging maps are made of two halves with n/2 and n-n/2 colors.
+ * Fill() therefore generates exactly the same colors as Generate().
+ */
+
+class evaluator; // internal
+
+class Evaluator {
+private:
+    Parameters _parameters;
+    std::vector<float> _hue_values;
+    std::vector<float> _hue_positions;
+    evaluator* _evaluator;
+
+public:
+    // Create an evaluator. The hue lists are copied.
+    explicit Evaluator(const Parameters& parameters);
+    ~Evaluator();
+
+    Evaluator(const Evaluator&) = delete;
+    Evaluator& operator=(const Evaluator&) = delete;
+
+    // The parameters of the color map
+    const Parameters& parameters() const
+    {
+        return _parameters;
+    }
+
+    // Compute the colors at the count positions t[i] in [0,1]; other values
+    // are clamped to [0,1]. Returns the number of clipped colors.
+    template<typename T>
+    int Evaluate(int count, const float* t, T* colormap) const;
+
+    // Generate the color map with parameters().n colors, like Generate().
+    // Returns the number of clipped colors.
+    template<typename T>
+    int Fill(T* colormap) const;
+
+    // Generate the color map with parameters().n colors that are evenly
+    // spaced in perceptual arc length instead of in t: entry i is the color
+    // where the arc length, i.e. the sum of the CIELAB distances along the
+    // map, reaches (i + 0.5) / n of the total. The arc length is measured on
+    // the given number of samples of the sRGB map; 0 means 4 * n but at least
+    // 1024. Returns the number of clipped colors.
+    template<typename T>
+    int FillArcLength(T* colormap, int samples = 0) const;
+};
+
 }
 
 #endif
@@ -0,0 +1,576 @@
+/*
+ * Copyright (C) 2015, 2016, 2017, 2018, 2019, 2020
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_CONSTEXPR_HPP
+#define COLORMAP_CONSTEXPR_HPP
+
+#if __cplusplus < 201703L
+# error "colormap_constexpr.hpp requires C++17"
+#endif
+
+#include <array>
+
+#include "colormap.hpp"
+
+/* Compile-time color maps.
+ *
+ * This optional header provides constexpr versions of some of the generator
+ * functions, so that fixed color maps can be embedded in a program without a
+ * code generation step at build time:
+ *
+ *   constexpr auto lut = ColorMap::Constexpr::BrewerSequential<256>();
+ *   static_assert(lut.clipped == 0, "colors were clipped");
+ *   // lut.srgb holds 256 sRGB triplets
+ *
+ * Unlike the rest of the library, which needs only C++11, this header requires
+ * C++17. The functions of <cmath> cannot be used in constant expressions, so
+ * the header brings its own approximations, which compute in double precision.
+ * Results can therefore differ from those of the runtime functions: a
+ * component can be off by one where its exact value is very close to the
+ * middle between two integers.
+ *
+ * Constant evaluation is slow. Very large maps may need a higher limit of the
+ * compiler, e.g. -fconstexpr-ops-limit with GCC or -fconstexpr-steps with
+ * Clang.
+ */
+
+namespace ColorMap {
+namespace Constexpr {
+
+template<int N>
+struct StaticColorMap {
+    std::array<unsigned char, 3 * N> srgb; // N sRGB triplets
+    int clipped;                           // number of clipped colors
+};
+
+namespace detail {
+
+/* Math functions */
+
+constexpr double pi = 3.14159265358979323846;
+constexpr double twopi = 2.0 * pi;
+constexpr double ln2 = 0.69314718055994530942;
+
+constexpr double abs(double x)
+{
+    return x < 0.0 ? -x : x;
+}
+
+constexpr double min(double x, double y)
+{
+    return x < y ? x : y;
+}
+
+constexpr double max(double x, double y)
+{
+    return x > y ? x : y;
+}
+
+constexpr double trunc(double x)
+{
+    return static_cast<double>(static_cast<long long>(x));
+}
+
+constexpr double fmod(double x, double y)
+{
+    return x - y * trunc(x / y);
+}
+
+constexpr double sqrt(double x)
+{
+    if (!(x > 0.0))
+        return 0.0;
+    double r = (x > 1.0 ? x : 1.0);
+    for (int i = 0; i < 2000; i++) {
+        double next = 0.5 * (r + x / r);
+        if (next >= r)
+            break;
+        r = next;
+    }
+    return r;
+}
+
+constexpr double exp(double x)
+{
+    long long k = static_cast<long long>(x / ln2 + (x < 0.0 ? -0.5 : 0.5));
+    double r = x - k * ln2;
+    double sum = 1.0;
+    double term = 1.0;
+    for (int i = 1; i < 30; i++) {
+        term *= r / i;
+        sum += term;
+    }
+    for (; k > 0; k--)
+        sum *= 2.0;
+    for (; k < 0; k++)
+        sum *= 0.5;
+    return sum;
+}
+
+constexpr double log(double x)
+{
+    int e = 0;
+    while (x > 2.0) {
+        x *= 0.5;
+        e++;
+    }
+    while (x < 1.0) {
+        x *= 2.0;
+        e--;
+    }
+    // log(x) = 2 atanh(z) with z in [0,1/3]
+    double z = (x - 1.0) / (x + 1.0);
+    double z2 = z * z;
+    double sum = 0.0;
+    double power = z;
+    for (int i = 1; i < 60; i += 2) {
+        sum += power / i;
+        power *= z2;
+    }
+    return 2.0 * sum + e * ln2;
+}
+
+constexpr double pow(double x, double y)
+{
+    return (x > 0.0 ? exp(y * log(x)) : 0.0);
+}
+
+constexpr double cbrt(double x)
+{
+    return (x < 0.0 ? -pow(-x, 1.0 / 3.0) : pow(x, 1.0 / 3.0));
+}
+
+constexpr double sin(double x)
+{
+    x = fmod(x, twopi);
+    if (x > pi)
+        x -= twopi;
+    else if (x < -pi)
+        x += twopi;
+    double x2 = x * x;
+    double term = x;
+    double sum = x;
+    for (int i = 1; i < 20; i++) {
+        term *= -x2 / ((2 * i) * (2 * i + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cos(double x)
+{
+    return sin(x + 0.5 * pi);
+}
+
+constexpr double atan(double x)
+{
+    if (x < 0.0)
+        return -atan(-x);
+    if (x > 1.0)
+        return 0.5 * pi - atan(1.0 / x);
+    // halve the angle twice so that the series converges quickly
+    for (int i = 0; i < 2; i++)
+        x = x / (1.0 + sqrt(1.0 + x * x));
+    double x2 = x * x;
+    double power = x;
+    double sum = 0.0;
+    for (int i = 0; i < 30; i++) {
+        sum += (i % 2 == 0 ? power : -power) / (2 * i + 1);
+        power *= x2;
+    }
+    return 4.0 * sum;
+}
+
+constexpr double atan2(double y, double x)
+{
+    if (x > 0.0)
+        return atan(y / x);
+    else if (x < 0.0)
+        return (y >= 0.0 ? atan(y / x) + pi : atan(y / x) - pi);
+    else
+        return (y > 0.0 ? 0.5 * pi : y < 0.0 ? -0.5 * pi : 0.0);
+}
+
+constexpr double hypot(double x, double y)
+{
+    return sqrt(x * x + y * y);
+}
+
+/* Colors and color space conversions, as in colormap.cpp */
+
+struct triplet {
+    double x, y, z;
+};
+
+constexpr triplet operator+(triplet t0, triplet t1)
+{
+    return triplet { t0.x + t1.x, t0.y + t1.y, t0.z + t1.z };
+}
+
+constexpr triplet operator*(double s, triplet t)
+{
+    return triplet { s * t.x, s * t.y, s * t.z };
+}
+
+constexpr triplet d65_xyz { 95.047, 100.000, 108.883 };
+
+constexpr double u_prime(triplet xyz)
+{
+    return 4.0 * xyz.x / (xyz.x + 15.0 * xyz.y + 3.0 * xyz.z);
+}
+
+constexpr double v_prime(triplet xyz)
+{
+    return 9.0 * xyz.y / (xyz.x + 15.0 * xyz.y + 3.0 * xyz.z);
+}
+
+constexpr double d65_u_prime = u_prime(d65_xyz);
+constexpr double d65_v_prime = v_prime(d65_xyz);
+
+constexpr triplet lch_to_luv(triplet lch)
+{
+    return triplet { lch.x, lch.y * cos(lch.z), lch.y * sin(lch.z) };
+}
+
+constexpr triplet luv_to_lch(triplet luv)
+{
+    triplet lch { luv.x, hypot(luv.y, luv.z), atan2(luv.z, luv.y) };
+    if (lch.z < 0.0)
+        lch.z += twopi;
+    return lch;
+}
+
+constexpr double lch_saturation(double l, double c)
+{
+    return c / max(l, 1e-8);
+}
+
+constexpr double lch_chroma(double l, double s)
+{
+    return s * l;
+}
+
+constexpr double lch_distance(triplet lch0, triplet lch1)
+{
+    return sqrt((lch0.x - lch1.x) * (lch0.x - lch1.x) + lch0.y * lch0.y + lch1.y * lch1.y
+            - 2.0 * lch0.y * lch1.y * cos(lch0.z - lch1.z));
+}
+
+constexpr triplet luv_to_xyz(triplet luv)
+{
+    if (luv.x <= 0.0)
+        return triplet { 0.0, 0.0, 0.0 };
+    double up = luv.y / (13.0 * luv.x) + d65_u_prime;
+    double vp = luv.z / (13.0 * luv.x) + d65_v_prime;
+    double y = 0.0;
+    if (luv.x <= 8.0) {
+        y = d65_xyz.y * luv.x * (27.0 / 24389.0);
+    } else {
+        double tmp = (luv.x + 16.0) / 116.0;
+        y = d65_xyz.y * tmp * tmp * tmp;
+    }
+    return triplet { y * (9.0 * up) / (4.0 * vp), y, y * (12.0 - 3.0 * up - 20.0 * vp) / (4.0 * vp) };
+}
+
+constexpr triplet xyz_to_luv(triplet xyz)
+{
+    double y_ratio = xyz.y / d65_xyz.y;
+    double l = (y_ratio <= 216.0 / 24389.0 ? 24389.0 / 27.0 * y_ratio : 116.0 * cbrt(y_ratio) - 16.0);
+    return triplet { l, 13.0 * l * (u_prime(xyz) - d65_u_prime), 13.0 * l * (v_prime(xyz) - d65_v_prime) };
+}
+
+constexpr double luv_saturation(triplet luv)
+{
+    return lch_saturation(luv.x, hypot(luv.y, luv.z));
+}
+
+constexpr triplet rgb_to_xyz(triplet rgb)
+{
+    return 100.0 * triplet {
+            (0.412391 * rgb.x + 0.357584 * rgb.y + 0.180481 * rgb.z),
+            (0.212639 * rgb.x + 0.715169 * rgb.y + 0.072192 * rgb.z),
+            (0.019331 * rgb.x + 0.119195 * rgb.y + 0.950532 * rgb.z) };
+}
+
+constexpr triplet xyz_to_rgb(triplet xyz)
+{
+    return 0.01 * triplet {
+            (+3.240970 * xyz.x - 1.537383 * xyz.y - 0.498611 * xyz.z),
+            (-0.969244 * xyz.x + 1.875968 * xyz.y + 0.041555 * xyz.z),
+            (+0.055630 * xyz.x - 0.203977 * xyz.y + 1.056972 * xyz.z) };
+}
+
+constexpr double rgb_to_srgb_helper(double x)
+{
+    return (x <= 0.0031308 ? (x * 12.92) : (1.055 * pow(x, 1.0 / 2.4) - 0.055));
+}
+
+constexpr triplet rgb_to_srgb(triplet rgb)
+{
+    return triplet { rgb_to_srgb_helper(rgb.x), rgb_to_srgb_helper(rgb.y), rgb_to_srgb_helper(rgb.z) };
+}
+
+constexpr double srgb_to_rgb_helper(double x)
+{
+    return (x <= 0.04045 ? (x / 12.92) : pow((x + 0.055) / 1.055, 2.4));
+}
+
+constexpr triplet srgb_to_rgb(triplet srgb)
+{
+    return triplet { srgb_to_rgb_helper(srgb.x), srgb_to_rgb_helper(srgb.y), srgb_to_rgb_helper(srgb.z) };
+}
+
+// Store an sRGB color in the map and return whether it was clipped
+constexpr bool store(triplet srgb, unsigned char* colormap)
+{
+    double v[3] = { srgb.x * 255.0, srgb.y * 255.0, srgb.z * 255.0 };
+    bool clipped = false;
+    for (int i = 0; i < 3; i++) {
+        // round half away from zero like std::round()
+        long long q = static_cast<long long>(v[i] < 0.0 ? v[i] - 0.5 : v[i] + 0.5);
+        if (q < 0 || q > 255)
+            clipped = true;
+        colormap[i] = (q < 0 ? 0 : q > 255 ? 255 : q);
+    }
+    return clipped;
+}
+
+/* Brewer-like color maps */
+
+constexpr double srgb_to_lch_hue(triplet srgb)
+{
+    return luv_to_lch(xyz_to_luv(rgb_to_xyz(srgb_to_rgb(srgb)))).z;
+}
+
+constexpr triplet most_saturated_in_srgb(double lch_hue)
+{
+    const double h[] = {
+        srgb_to_lch_hue(triplet { 1, 0, 0 }),
+        srgb_to_lch_hue(triplet { 1, 1, 0 }),
+        srgb_to_lch_hue(triplet { 0, 1, 0 }),
+        srgb_to_lch_hue(triplet { 0, 1, 1 }),
+        srgb_to_lch_hue(triplet { 0, 0, 1 }),
+        srgb_to_lch_hue(triplet { 1, 0, 1 })
+    };
+    int i = 2, j = 1, k = 0;
+    if (lch_hue < h[0]) {
+        i = 2; j = 1; k = 0;
+    } else if (lch_hue < h[1]) {
+        i = 1; j = 2; k = 0;
+    } else if (lch_hue < h[2]) {
+        i = 0; j = 2; k = 1;
+    } else if (lch_hue < h[3]) {
+        i = 2; j = 0; k = 1;
+    } else if (lch_hue < h[4]) {
+        i = 1; j = 0; k = 2;
+    } else if (lch_hue < h[5]) {
+        i = 0; j = 1; k = 2;
+    }
+    const double M[3][3] = {
+        { 0.4124, 0.3576, 0.1805 },
+        { 0.2126, 0.7152, 0.0722 },
+        { 0.0193, 0.1192, 0.9505 }
+    };
+    double alpha = -sin(lch_hue);
+    double beta = cos(lch_hue);
+    double T = alpha * d65_u_prime + beta * d65_v_prime;
+    double srgb[3] = { 0.0, 0.0, 0.0 };
+    srgb[j] = 0.0;
+    srgb[k] = 1.0;
+    double q0 = T * (M[0][k] + 15.0 * M[1][k] + 3.0 * M[2][k]) - (4.0 * alpha * M[0][k] + 9.0 * beta * M[1][k]);
+    double q1 = T * (M[0][i] + 15.0 * M[1][i] + 3.0 * M[2][i]) - (4.0 * alpha * M[0][i] + 9.0 * beta * M[1][i]);
+    srgb[i] = rgb_to_srgb_helper(min(max(-q0 / q1, 0.0), 1.0));
+    return xyz_to_luv(rgb_to_xyz(srgb_to_rgb(triplet { srgb[0], srgb[1], srgb[2] })));
+}
+
+constexpr double s_max(double l, double h)
+{
+    triplet pmid = most_saturated_in_srgb(h);
+    triplet pend { 0.0, 0.0, 0.0 };
+    if (l > pmid.x)
+        pend.x = 100.0;
+    double alpha = (pend.x - l) / (pend.x - pmid.x);
+    double pmids = luv_saturation(pmid);
+    double pends = luv_saturation(pend);
+    return alpha * (pmids - pends) + pends;
+}
+
+constexpr double mix_hue(double alpha, double h0, double h1)
+{
+    double M = fmod(pi + h1 - h0, twopi) - pi;
+    return fmod(h0 + alpha * M, twopi);
+}
+
+constexpr triplet b(triplet b0, triplet b1, triplet b2, double t)
+{
+    return ((1.0 - t) * (1.0 - t)) * b0 + (2.0 * (1.0 - t) * t) * b1 + (t * t) * b2;
+}
+
+constexpr double inv_b(double b0, double b1, double b2, double v)
+{
+    return (b0 - b1 + sqrt(max(b1 * b1 - b0 * b2 + (b0 - 2.0 * b1 + b2) * v, 0.0)))
+        / (b0 - 2.0 * b1 + b2);
+}
+
+/* PU color maps */
+
+constexpr triplet lch_compute_uniform_lc(double t, double t0, double t1,
+        triplet lch0, triplet lch1, double D, double hue)
+{
+    double s = (t - t0) / (t1 - t0);
+    double l = (1.0 - s) * lch0.x + s * lch1.x;
+    double cs[4] = {};
+    double tmp00 = lch0.y * cos(hue - lch0.z);
+    double tmp01 = max(0.0, tmp00 * tmp00 - (l - lch0.x) * (l - lch0.x) - lch0.y * lch0.y + (s * D) * (s * D));
+    cs[0] = tmp00 + sqrt(tmp01);
+    cs[1] = tmp00 - sqrt(tmp01);
+    double tmp10 = lch1.y * cos(hue - lch1.z);
+    double tmp11 = max(0.0, tmp10 * tmp10 - (l - lch1.x) * (l - lch1.x) - lch1.y * lch1.y + ((1.0 - s) * D) * ((1.0 - s) * D));
+    cs[2] = tmp10 + sqrt(tmp11);
+    cs[3] = tmp10 - sqrt(tmp11);
+    double min_c = min(lch0.y, lch1.y);
+    double max_c = max(lch0.y, lch1.y);
+    double min_error = 9999.9;
+    int min_index = -1;
+    for (int i = 0; i < 4; i++) {
+        if (cs[i] >= min_c && cs[i] <= max_c) {
+            double d0 = lch_distance(lch0, triplet { l, cs[i], hue });
+            double d1 = lch_distance(lch1, triplet { l, cs[i], hue });
+            double error = abs(d0 - s * D) + abs(d1 - (1.0 - s) * D);
+            if (min_index == -1 || error < min_error) {
+                min_error = error;
+                min_index = i;
+            }
+        }
+    }
+    return triplet { l, (min_index == -1 ? 0.5 * (lch0.y + lch1.y) : cs[min_index]), hue };
+}
+
+}
+
+/* Brewer-like sequential color map; see ColorMap::BrewerSequential() */
+
+template<int N>
+constexpr StaticColorMap<N> BrewerSequential(
+        float hue = BrewerSequentialDefaultHue,
+        float contrast = BrewerSequentialDefaultContrast,
+        float saturation = BrewerSequentialDefaultSaturation,
+        float brightness = BrewerSequentialDefaultBrightness,
+        float warmth = BrewerSequentialDefaultWarmth)
+{
+    using namespace detail;
+    triplet pb = xyz_to_luv(rgb_to_xyz(triplet { 1.0, 1.0, 0.0 }));
+    triplet pb_lch = luv_to_lch(pb);
+    double pbs = lch_saturation(pb_lch.x, pb_lch.y);
+    triplet p0 = lch_to_luv(triplet { 0.0, 0.0, hue });
+    triplet p1 = most_saturated_in_srgb(hue);
+    triplet p2_lch {};
+    p2_lch.x = (1.0 - warmth) * 100.0 + warmth * pb.x;
+    p2_lch.z = mix_hue(warmth, hue, pb_lch.z);
+    p2_lch.y = lch_chroma(p2_lch.x, min(s_max(p2_lch.x, p2_lch.z), warmth * saturation * pbs));
+    triplet p2 = lch_to_luv(p2_lch);
+    triplet q0 = (1.0 - saturation) * p0 + saturation * p1;
+    triplet q2 = (1.0 - saturation) * p2 + saturation * p1;
+    triplet q1 = 0.5 * (q0 + q2);
+
+    StaticColorMap<N> map {};
+    for (int i = 0; i < N; i++) {
+        double t = (i + 0.5) / N;
+        double l = 125.0 - 125.0 * pow(0.2, (1.0 - contrast) * brightness + t * contrast);
+        double T = (l <= q1.x ? 0.5 * inv_b(p0.x, q0.x, q1.x, l) : 0.5 * inv_b(q1.x, q2.x, p2.x, l) + 0.5);
+        triplet luv = (T <= 0.5 ? b(p0, q0, q1, 2.0 * T) : b(q1, q2, p2, 2.0 * (T - 0.5)));
+        if (store(rgb_to_srgb(xyz_to_rgb(luv_to_xyz(luv))), map.srgb.data() + 3 * i))
+            map.clipped++;
+    }
+    return map;
+}
+
+/* Perceptually uniform sequential color map with varying lightness; see
+ * ColorMap::PUSequentialLightness() */
+
+template<int N>
+constexpr StaticColorMap<N> PUSequentialLightness(
+        float lightness_range = PUSequentialLightnessDefaultLightnessRange,
+        float saturation_range = PUSequentialLightnessDefaultSaturationRange,
+        float saturation = PUSequentialLightnessDefaultSaturation,
+        float hue = PUSequentialLightnessDefaultHue)
+{
+    using namespace detail;
+    triplet lch_00 {}, lch_10 {}, lch_05 {};
+    lch_00.x = (1.0 - lightness_range) * 100.0;
+    lch_00.y = lch_chroma(lch_00.x, 1.0 - saturation_range);
+    lch_00.z = hue;
+    lch_10.x = lightness_range * 100.0;
+    lch_10.y = lch_chroma(lch_10.x, 1.0 - saturation_range);
+    lch_10.z = hue;
+    lch_05.x = 0.5 * lch_00.x + 0.5 * lch_10.x;
+    lch_05.y = lch_chroma(lch_05.x, 5.0 * saturation_range * saturation);
+    lch_05.z = hue;
+    double D_00_05 = lch_distance(lch_00, lch_05);
+    double D_05_10 = lch_distance(lch_05, lch_10);
+
+    StaticColorMap<N> map {};
+    for (int i = 0; i < N; i++) {
+        double t = (i + 0.5) / N;
+        triplet lch = (t <= 0.5
+                ? lch_compute_uniform_lc(t, 0.0, 0.5, lch_00, lch_05, D_00_05, hue)
+                : lch_compute_uniform_lc(t, 0.5, 1.0, lch_05, lch_10, D_05_10, hue));
+        if (store(rgb_to_srgb(xyz_to_rgb(luv_to_xyz(lch_to_luv(lch)))), map.srgb.data() + 3 * i))
+            map.clipped++;
+    }
+    return map;
+}
+
+/* CubeHelix color map; see ColorMap::CubeHelix() */
+
+template<int N>
+constexpr StaticColorMap<N> CubeHelix(
+        float hue = CubeHelixDefaultHue,
+        float rotations = CubeHelixDefaultRotations,
+        float saturation = CubeHelixDefaultSaturation,
+        float gamma = CubeHelixDefaultGamma)
+{
+    using namespace detail;
+    StaticColorMap<N> map {};
+    for (int i = 0; i < N; i++) {
+        double fract = (i + 0.5) / N;
+        double angle = twopi * (hue / 3.0 + 1.0 + rotations * fract);
+        fract = pow(fract, gamma);
+        double amp = saturation * fract * (1.0 - fract) / 2.0;
+        double s = sin(angle);
+        double c = cos(angle);
+        triplet srgb {
+            fract + amp * (-0.14861 * c + 1.78277 * s),
+            fract + amp * (-0.29227 * c - 0.90649 * s),
+            fract + amp * (1.97294 * c) };
+        if (store(srgb, map.srgb.data() + 3 * i))
+            map.clipped++;
+    }
+    return map;
+}
+
+}
+}
+
+#endif
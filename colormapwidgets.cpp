@@ -22,6 +22,8 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+
 #include "gui.hpp"
 
 #include <QGridLayout>
@@ -135,34 +137,34 @@ ColorMapWidget::~ColorMapWidget()
 
 QImage ColorMapWidget::colorMapImage(const QVector<unsigned char>& colormap, int width, int height)
 {
-    QVector<QColor> qcolormap(colormap.size() / 3);
-    for (int i = 0; i < qcolormap.size(); i++)
-        qcolormap[i] = QColor(colormap[3 * i + 0], colormap[3 * i + 1], colormap[3 * i + 2]);
+    int n = colormap.size() / 3;
+    QVector<QRgb> rgb(n);
+    for (int i = 0; i < n; i++)
+        rgb[i] = qRgb(colormap[3 * i + 0], colormap[3 * i + 1], colormap[3 * i + 2]);
 
     if (width <= 0)
-        width = qcolormap.size();
+        width = n;
     if (height <= 0)
-        height = qcolormap.size();
+        height = n;
     QImage img(width, height, QImage::Format_RGB32);
     bool y_direction = (height > width);
     if (y_direction) {
+        float entry_height = height / static_cast<float>(n);
         for (int y = 0; y < height; y++) {
-            float entry_height = height / static_cast<float>(qcolormap.size());
             int i = y / entry_height;
-            QRgb rgb = qcolormap[i].rgb();
             QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(height - 1 - y));
-            for (int x = 0; x < width; x++)
-                scanline[x] = rgb;
+            std::fill(scanline, scanline + width, rgb[i]);
         }
     } else {
-        for (int y = 0; y < height; y++) {
-            QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(y));
-            for (int x = 0; x < width; x++) {
-                float entry_width = width / static_cast<float>(qcolormap.size());
-                int i = x / entry_width;
-                scanline[x] = qcolormap[i].rgb();
-            }
+        // all scanlines are the same
+        float entry_width = width / static_cast<float>(n);
+        QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(0));
+        for (int x = 0; x < width; x++) {
+            int i = x / entry_width;
+            scanline[x] = rgb[i];
         }
+        for (int y = 1; y < height; y++)
+            std::copy(scanline, scanline + width, reinterpret_cast<QRgb*>(img.scanLine(y)));
     }
     return img;
 }
@@ -273,6 +275,20 @@ QVector<unsigned char> ColorMapBrewerSequentialWidget::colorMap(int* clipped) co
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapBrewerSequentialWidget::colorMapEvaluator() const
+{
+    int n;
+    float h, c, s, b, w;
+    parameters(n, h, c, s, b, w);
+    ColorMap::Parameters p(ColorMap::TypeBrewerSequential, n);
+    p.hue = h;
+    p.contrast = c;
+    p.saturation = s;
+    p.brightness = b;
+    p.warmth = w;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapBrewerSequentialWidget::reference() const
 {
     return brewerlike_reference;
@@ -390,6 +406,21 @@ QVector<unsigned char> ColorMapBrewerDivergingWidget::colorMap(int* clipped) con
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapBrewerDivergingWidget::colorMapEvaluator() const
+{
+    int n;
+    float h, d, c, s, b, w;
+    parameters(n, h, d, c, s, b, w);
+    ColorMap::Parameters p(ColorMap::TypeBrewerDiverging, n);
+    p.hue = h;
+    p.divergence = d;
+    p.contrast = c;
+    p.saturation = s;
+    p.brightness = b;
+    p.warmth = w;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapBrewerDivergingWidget::reference() const
 {
     return brewerlike_reference;
@@ -509,6 +540,20 @@ QVector<unsigned char> ColorMapBrewerQualitativeWidget::colorMap(int* clipped) c
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapBrewerQualitativeWidget::colorMapEvaluator() const
+{
+    int n;
+    float h, d, c, s, b;
+    parameters(n, h, d, c, s, b);
+    ColorMap::Parameters p(ColorMap::TypeBrewerQualitative, n);
+    p.hue = h;
+    p.divergence = d;
+    p.contrast = c;
+    p.saturation = s;
+    p.brightness = b;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapBrewerQualitativeWidget::reference() const
 {
     return brewerlike_reference;
@@ -610,6 +655,19 @@ QVector<unsigned char> ColorMapPUSequentialLightnessWidget::colorMap(int* clippe
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapPUSequentialLightnessWidget::colorMapEvaluator() const
+{
+    int n;
+    float lr, sr, s, h;
+    parameters(n, lr, sr, s, h);
+    ColorMap::Parameters p(ColorMap::TypePUSequentialLightness, n);
+    p.lightness_range = lr;
+    p.saturation_range = sr;
+    p.saturation = s;
+    p.hue = h;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapPUSequentialLightnessWidget::reference() const
 {
     return pu_reference;
@@ -709,6 +767,19 @@ QVector<unsigned char> ColorMapPUSequentialSaturationWidget::colorMap(int* clipp
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapPUSequentialSaturationWidget::colorMapEvaluator() const
+{
+    int n;
+    float sr, l, s, h;
+    parameters(n, sr, l, s, h);
+    ColorMap::Parameters p(ColorMap::TypePUSequentialSaturation, n);
+    p.saturation_range = sr;
+    p.lightness = l;
+    p.saturation = s;
+    p.hue = h;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapPUSequentialSaturationWidget::reference() const
 {
     return pu_reference;
@@ -816,6 +887,20 @@ QVector<unsigned char> ColorMapPUSequentialRainbowWidget::colorMap(int* clipped)
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapPUSequentialRainbowWidget::colorMapEvaluator() const
+{
+    int n;
+    float lr, sr, h, r, s;
+    parameters(n, lr, sr, h, r, s);
+    ColorMap::Parameters p(ColorMap::TypePUSequentialRainbow, n);
+    p.lightness_range = lr;
+    p.saturation_range = sr;
+    p.hue = h;
+    p.rotations = r;
+    p.saturation = s;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapPUSequentialRainbowWidget::reference() const
 {
     return pu_reference;
@@ -926,6 +1011,20 @@ QVector<unsigned char> ColorMapPUSequentialBlackBodyWidget::colorMap(int* clippe
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapPUSequentialBlackBodyWidget::colorMapEvaluator() const
+{
+    int n;
+    float t, tr, lr, sr, s;
+    parameters(n, t, tr, lr, sr, s);
+    ColorMap::Parameters p(ColorMap::TypePUSequentialBlackBody, n);
+    p.temperature = t;
+    p.temperature_range = tr;
+    p.lightness_range = lr;
+    p.saturation_range = sr;
+    p.saturation = s;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapPUSequentialBlackBodyWidget::reference() const
 {
     return pu_reference;
@@ -1078,6 +1177,22 @@ QVector<unsigned char> ColorMapPUSequentialMultiHueWidget::colorMap(int* clipped
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapPUSequentialMultiHueWidget::colorMapEvaluator() const
+{
+    int n;
+    QVector<float> hue_values, hue_positions;
+    float lr, sr, s;
+    parameters(n, lr, sr, s, hue_values, hue_positions);
+    ColorMap::Parameters p(ColorMap::TypePUSequentialMultiHue, n);
+    p.lightness_range = lr;
+    p.saturation_range = sr;
+    p.saturation = s;
+    p.hues = hue_values.size();
+    p.hue_values = hue_values.constData();
+    p.hue_positions = hue_positions.constData();
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapPUSequentialMultiHueWidget::reference() const
 {
     return pu_reference;
@@ -1246,6 +1361,20 @@ QVector<unsigned char> ColorMapPUDivergingLightnessWidget::colorMap(int* clipped
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapPUDivergingLightnessWidget::colorMapEvaluator() const
+{
+    int n;
+    float lr, sr, s, h, d;
+    parameters(n, lr, sr, s, h, d);
+    ColorMap::Parameters p(ColorMap::TypePUDivergingLightness, n);
+    p.lightness_range = lr;
+    p.saturation_range = sr;
+    p.saturation = s;
+    p.hue = h;
+    p.divergence = d;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapPUDivergingLightnessWidget::reference() const
 {
     return pu_reference;
@@ -1354,6 +1483,20 @@ QVector<unsigned char> ColorMapPUDivergingSaturationWidget::colorMap(int* clippe
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapPUDivergingSaturationWidget::colorMapEvaluator() const
+{
+    int n;
+    float sr, l, s, h, d;
+    parameters(n, sr, l, s, h, d);
+    ColorMap::Parameters p(ColorMap::TypePUDivergingSaturation, n);
+    p.saturation_range = sr;
+    p.lightness = l;
+    p.saturation = s;
+    p.hue = h;
+    p.divergence = d;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapPUDivergingSaturationWidget::reference() const
 {
     return pu_reference;
@@ -1454,6 +1597,19 @@ QVector<unsigned char> ColorMapPUQualitativeHueWidget::colorMap(int* clipped) co
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapPUQualitativeHueWidget::colorMapEvaluator() const
+{
+    int n;
+    float h, d, l, s;
+    parameters(n, h, d, l, s);
+    ColorMap::Parameters p(ColorMap::TypePUQualitativeHue, n);
+    p.hue = h;
+    p.divergence = d;
+    p.lightness = l;
+    p.saturation = s;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapPUQualitativeHueWidget::reference() const
 {
     return pu_reference;
@@ -1553,6 +1709,19 @@ QVector<unsigned char> ColorMapCubeHelixWidget::colorMap(int* clipped) const
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapCubeHelixWidget::colorMapEvaluator() const
+{
+    int n;
+    float h, r, s, g;
+    parameters(n, h, r, s, g);
+    ColorMap::Parameters p(ColorMap::TypeCubeHelix, n);
+    p.hue = h;
+    p.rotations = r;
+    p.saturation = s;
+    p.gamma = g;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapCubeHelixWidget::reference() const
 {
     return cubehelix_reference;
@@ -1695,6 +1864,21 @@ QVector<unsigned char> ColorMapMorelandWidget::colorMap(int* clipped) const
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapMorelandWidget::colorMapEvaluator() const
+{
+    int n;
+    unsigned char r0, g0, b0, r1, g1, b1;
+    parameters(n, r0, g0, b0, r1, g1, b1);
+    ColorMap::Parameters p(ColorMap::TypeMoreland, n);
+    p.color0[0] = r0;
+    p.color0[1] = g0;
+    p.color0[2] = b0;
+    p.color1[0] = r1;
+    p.color1[1] = g1;
+    p.color1[2] = b1;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapMorelandWidget::reference() const
 {
     return moreland_reference;
@@ -1776,6 +1960,16 @@ QVector<unsigned char> ColorMapMcNamesWidget::colorMap(int* clipped) const
     return colormap;
 }
 
+ColorMap::Evaluator* ColorMapMcNamesWidget::colorMapEvaluator() const
+{
+    int n;
+    float p;
+    parameters(n, p);
+    ColorMap::Parameters p(ColorMap::TypeMcNames, n);
+    p.periods = p;
+    return new ColorMap::Evaluator(p);
+}
+
 QString ColorMapMcNamesWidget::reference() const
 {
     return mcnames_references;
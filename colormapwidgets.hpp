@@ -34,6 +34,10 @@ class QDoubleSpinBox;
 class QPushButton;
 class QListWidget;
 
+namespace ColorMap {
+class Evaluator;
+}
+
 // Internal helper class for a slider/spinbox combination
 class ColorMapCombinedSliderSpinBox : public QObject
 {
@@ -75,6 +79,11 @@ public:
      * Also return the number of clipped colors unless 'clipped' is NULL. */
     virtual QVector<unsigned char> colorMap(int* clipped = NULL) const = 0;
 
+    /* Get an evaluator for the color map corresponding to the current values.
+     * The caller takes ownership. Unlike the widget, the evaluator can be used
+     * from any thread. */
+    virtual ColorMap::Evaluator* colorMapEvaluator() const = 0;
+
     /* Transform a color map to an image of the specified size. If width or
      * height is zero, then it will be set to the number of colors in the
      * color map. */
@@ -107,6 +116,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& hue,
             float& contrast, float& saturation, float& brightness, float& warmth) const;
@@ -133,6 +143,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& hue, float& divergence,
             float& contrast, float& saturation, float& brightness, float& warmth) const;
@@ -158,6 +169,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& hue, float& divergence,
             float& contrast, float& saturation, float& brightness) const;
@@ -182,6 +194,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& lightness_range, float& saturation_range, float& saturation, float& hue) const;
 };
@@ -205,6 +218,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& saturation_range, float& lightness, float& saturation, float& hue) const;
 };
@@ -229,6 +243,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& lightness_range, float& saturation_range, float& hue, float& rotations, float& saturation) const;
 };
@@ -253,6 +268,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& temperature, float& temperature_range, float& lightness_range, float& saturation_range, float& saturation) const;
 };
@@ -284,6 +300,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n,
             float& lr, float& sr, float& s,
@@ -310,6 +327,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& lightness_range, float& saturation_range, float& saturation, float& hue, float& divergence) const;
 };
@@ -334,6 +352,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& saturation_range, float& lightness, float& saturation, float& hue, float& divergence) const;
 };
@@ -357,6 +376,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& hue, float& divergence, float& lightness, float& saturation) const;
 };
@@ -380,6 +400,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& hue, float& rotations,
             float& saturation, float& gamma) const;
@@ -406,6 +427,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n,
             unsigned char& r0, unsigned char& g0, unsigned char& b0,
@@ -428,6 +450,7 @@ public:
 
     void reset() override;
     QVector<unsigned char> colorMap(int* clipped = NULL) const override;
+    ColorMap::Evaluator* colorMapEvaluator() const override;
     QString reference() const override;
     void parameters(int& n, float& p) const;
 };
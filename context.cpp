@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstddef>
+
+#include "context.hpp"
+
+namespace ColorMap {
+
+// Select the pool of a context for the calling thread during a call
+class pool_scope {
+private:
+    ThreadPool* _previous;
+public:
+    pool_scope(ThreadPool* pool) : _previous(UseThreadPool(pool)) {}
+    ~pool_scope() { UseThreadPool(_previous); }
+};
+
+Context::Context(int threads) : _pool(CreateThreadPool(threads))
+{
+}
+
+Context::~Context()
+{
+    DestroyThreadPool(_pool);
+}
+
+int Context::Threads() const
+{
+    return ThreadPoolThreads(_pool);
+}
+
+template<typename T>
+int Context::Generate(const Parameters& parameters, T* colormap)
+{
+    pool_scope scope(_pool);
+    return ColorMap::Generate(parameters, colormap);
+}
+
+template<typename T>
+int Context::Generate(int count, const Parameters* parameters, T* colormaps, int* clipped)
+{
+    pool_scope scope(_pool);
+    return ColorMap::Generate(count, parameters, colormaps, clipped);
+}
+
+const std::string& Context::Export(Format format, int n, const unsigned char* srgb_colormap)
+{
+    // clear() keeps the storage of the string
+    _text.clear();
+    StringWriter writer(_text);
+    ColorMap::Export(format, n, srgb_colormap, writer);
+    return _text;
+}
+
+void Context::Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        int width, int height, const float* values, int values_stride,
+        unsigned char* output, int output_stride)
+{
+    pool_scope scope(_pool);
+    ColorMap::Apply(n, srgb_colormap, parameters, width, height, values, values_stride, output, output_stride);
+}
+
+void Context::Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+        int width, int height, const unsigned short* values, int values_stride,
+        unsigned char* output, int output_stride)
+{
+    pool_scope scope(_pool);
+    if (size_t(width) * size_t(height) < 4 * size_t(ApplyLUTEntries)) {
+        ColorMap::Apply(n, srgb_colormap, parameters, width, height, values, values_stride, output, output_stride);
+        return;
+    }
+    if (_lut.size() < size_t(ApplyLUTSize(parameters)))
+        _lut.resize(ApplyLUTSize(parameters));
+    BuildApplyLUT(n, srgb_colormap, parameters, _lut.data());
+    ApplyLUT(_lut.data(), parameters, width, height, values, values_stride, output, output_stride);
+}
+
+/* Instantiations for all supported component types */
+
+#define INSTANTIATE(T) \
+    template int Context::Generate(const Parameters&, T*); \
+    template int Context::Generate(int, const Parameters*, T*, int*);
+
+INSTANTIATE(unsigned char)
+INSTANTIATE(unsigned short)
+INSTANTIATE(float)
+INSTANTIATE(half)
+
+}
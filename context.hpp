@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_CONTEXT_HPP
+#define COLORMAP_CONTEXT_HPP
+
+#include <string>
+#include <vector>
+
+#include "colormap.hpp"
+#include "apply.hpp"
+#include "export.hpp"
+
+/* Contexts.
+ *
+ * A Context holds the state that is worth keeping across calls in a long
+ * running program, e.g. a service that generates color maps per request: its
+ * own thread pool, and buffers for exported text and lookup tables that keep
+ * their storage from one call to the next. Generating color maps through a
+ * context allocates no heap memory once the context is warmed up, except for
+ * distinct qualitative maps, whose palette is computed per call; exporting
+ * and applying only allocate when a call needs more buffer space than all
+ * previous ones.
+ *
+ * A context must only be used by one thread at a time. Use one context per
+ * thread to generate color maps concurrently.
+ */
+
+namespace ColorMap {
+
+class Context {
+private:
+    ThreadPool* _pool;
+    std::string _text;
+    std::vector<unsigned char> _lut;
+
+public:
+    // Create a context with its own pool of the given number of threads;
+    // 0 means one thread per processor core.
+    explicit Context(int threads = 1);
+    ~Context();
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    // The number of threads of this context
+    int Threads() const;
+
+    // Generate color maps like the Generate() functions in colormap.hpp
+    template<typename T>
+    int Generate(const Parameters& parameters, T* colormap);
+    template<typename T>
+    int Generate(int count, const Parameters* parameters, T* colormaps, int* clipped = NULL);
+
+    // Export a color map like Export() in export.hpp. The result is stored in
+    // a buffer of the context and is valid until the next call.
+    const std::string& Export(Format format, int n, const unsigned char* srgb_colormap);
+
+    // Apply a color map to an image like Apply() in apply.hpp. For 16 bit
+    // input, the lookup table is built in a buffer of the context.
+    void Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+            int width, int height, const float* values, int values_stride,
+            unsigned char* output, int output_stride = 0);
+    void Apply(int n, const unsigned char* srgb_colormap, const ApplyParameters& parameters,
+            int width, int height, const unsigned short* values, int values_stride,
+            unsigned char* output, int output_stride = 0);
+};
+
+}
+
+#endif
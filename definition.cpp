@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "definition.hpp"
+
+namespace ColorMap {
+
+/* The names of the types, in the order of ColorMap::Type */
+static const char* type_names[] = {
+    "brewer-sequential",
+    "brewer-diverging",
+    "brewer-qualitative",
+    "pusequential-lightness",
+    "pusequential-saturation",
+    "pusequential-rainbow",
+    "pusequential-blackbody",
+    "pusequential-multihue",
+    "pudiverging-lightness",
+    "pudiverging-saturation",
+    "puqualitative-hue",
+    "cubehelix",
+    "moreland",
+    "mcnames",
+    "distinct"
+};
+
+static_assert(sizeof(type_names) / sizeof(type_names[0]) == TypeCount, "missing type names");
+
+const char* TypeName(Type type)
+{
+    return type_names[type];
+}
+
+int ParseTypeName(const char* name)
+{
+    for (int i = 0; i < TypeCount; i++)
+        if (std::strcmp(name, type_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+/* The float fields, and the fields that each type uses. These are the same
+ * fields that Hash() covers. */
+
+struct float_field {
+    const char* name;
+    float Parameters::* member;
+};
+
+static const float_field float_fields[] = {
+    { "hue",               &Parameters::hue },
+    { "divergence",        &Parameters::divergence },
+    { "contrast",          &Parameters::contrast },
+    { "saturation",        &Parameters::saturation },
+    { "saturation-range",  &Parameters::saturation_range },
+    { "brightness",        &Parameters::brightness },
+    { "warmth",            &Parameters::warmth },
+    { "lightness",         &Parameters::lightness },
+    { "lightness-range",   &Parameters::lightness_range },
+    { "rotations",         &Parameters::rotations },
+    { "temperature",       &Parameters::temperature },
+    { "temperature-range", &Parameters::temperature_range },
+    { "gamma",             &Parameters::gamma },
+    { "periods",           &Parameters::periods }
+};
+
+static const int float_field_count = sizeof(float_fields) / sizeof(float_fields[0]);
+
+static std::vector<const char*> type_fields(Type type)
+{
+    switch (type) {
+    case TypeBrewerSequential:
+        return { "hue", "contrast", "saturation", "brightness", "warmth" };
+    case TypeBrewerDiverging:
+        return { "hue", "divergence", "contrast", "saturation", "brightness", "warmth" };
+    case TypeBrewerQualitative:
+        return { "hue", "divergence", "contrast", "saturation", "brightness" };
+    case TypePUSequentialLightness:
+        return { "lightness-range", "saturation-range", "saturation", "hue" };
+    case TypePUSequentialSaturation:
+        return { "saturation-range", "lightness", "saturation", "hue" };
+    case TypePUSequentialRainbow:
+        return { "lightness-range", "saturation-range", "hue", "rotations", "saturation" };
+    case TypePUSequentialBlackBody:
+        return { "temperature", "temperature-range", "lightness-range", "saturation-range", "saturation" };
+    case TypePUSequentialMultiHue:
+        return { "lightness-range", "saturation-range", "saturation", "hue-values", "hue-positions" };
+    case TypePUDivergingLightness:
+        return { "lightness-range", "saturation-range", "saturation", "hue", "divergence" };
+    case TypePUDivergingSaturation:
+        return { "saturation-range", "lightness", "saturation", "hue", "divergence" };
+    case TypePUQualitativeHue:
+        return { "hue", "divergence", "lightness", "saturation" };
+    case TypeCubeHelix:
+        return { "hue", "rotations", "saturation", "gamma" };
+    case TypeMoreland:
+        return { "color0", "color1" };
+    case TypeMcNames:
+        return { "periods" };
+    case TypeDistinct:
+        return { "hue", "lightness-range", "saturation" };
+    }
+    return {};
+}
+
+static void append_float(std::string& s, float x)
+{
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%a", x);
+    s += buf;
+}
+
+static void append_floats(std::string& s, int count, const float* x)
+{
+    for (int i = 0; i < count; i++) {
+        if (i > 0)
+            s += ',';
+        append_float(s, x[i]);
+    }
+}
+
+static void append_color(std::string& s, const unsigned char* color)
+{
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%d,%d,%d", color[0], color[1], color[2]);
+    s += buf;
+}
+
+std::string ToDefinition(const Parameters& p)
+{
+    std::string s = DefinitionMagic;
+    s += ' ';
+    s += std::to_string(DefinitionVersion);
+    s += " type=";
+    s += TypeName(p.type);
+    s += " n=";
+    s += std::to_string(p.n);
+    std::vector<const char*> fields = type_fields(p.type);
+    for (size_t i = 0; i < fields.size(); i++) {
+        s += ' ';
+        s += fields[i];
+        s += '=';
+        if (std::strcmp(fields[i], "hue-values") == 0) {
+            append_floats(s, p.hues, p.hue_values);
+        } else if (std::strcmp(fields[i], "hue-positions") == 0) {
+            append_floats(s, p.hues, p.hue_positions);
+        } else if (std::strcmp(fields[i], "color0") == 0) {
+            append_color(s, p.color0);
+        } else if (std::strcmp(fields[i], "color1") == 0) {
+            append_color(s, p.color1);
+        } else {
+            for (int j = 0; j < float_field_count; j++)
+                if (std::strcmp(fields[i], float_fields[j].name) == 0)
+                    append_float(s, p.*(float_fields[j].member));
+        }
+    }
+    s += '\n';
+    return s;
+}
+
+/* Parsing */
+
+// Parse a float that ends at end. Returns false if it is invalid.
+static bool parse_float(const char* s, const char* end, float* x)
+{
+    char* e;
+    *x = std::strtof(s, &e);
+    return e == end && e != s;
+}
+
+static bool parse_floats(const char* s, const char* end, std::vector<float>& x)
+{
+    x.clear();
+    for (;;) {
+        const char* comma = static_cast<const char*>(std::memchr(s, ',', end - s));
+        float v;
+        if (!parse_float(s, comma ? comma : end, &v))
+            return false;
+        x.push_back(v);
+        if (!comma)
+            return true;
+        s = comma + 1;
+    }
+}
+
+static bool parse_color(const char* s, const char* end, unsigned char* color)
+{
+    std::vector<float> c;
+    if (!parse_floats(s, end, c) || c.size() != 3)
+        return false;
+    for (int i = 0; i < 3; i++) {
+        if (!(c[i] >= 0.0f && c[i] <= 255.0f) || c[i] != int(c[i]))
+            return false;
+        color[i] = c[i];
+    }
+    return true;
+}
+
+// The value of key in the space separated key=value words, or NULL
+static const char* find_value(const std::vector<std::string>& words, const char* key)
+{
+    size_t key_len = std::strlen(key);
+    for (size_t i = 0; i < words.size(); i++)
+        if (words[i].compare(0, key_len, key) == 0 && words[i][key_len] == '=')
+            return words[i].c_str() + key_len + 1;
+    return NULL;
+}
+
+bool ParseDefinition(const char* definition, Parameters& p,
+        std::vector<float>& hue_values, std::vector<float>& hue_positions)
+{
+    std::vector<std::string> words;
+    for (const char* s = definition; *s; ) {
+        size_t len = std::strcspn(s, " \t\r\n");
+        if (len > 0)
+            words.push_back(std::string(s, len));
+        s += len;
+        if (*s)
+            s++;
+    }
+    if (words.size() < 4 || words[0] != DefinitionMagic || words[1] != std::to_string(DefinitionVersion))
+        return false;
+    words.erase(words.begin(), words.begin() + 2);
+
+    const char* type_name = find_value(words, "type");
+    const char* n_value = find_value(words, "n");
+    if (!type_name || !n_value)
+        return false;
+    int type = ParseTypeName(type_name);
+    char* end;
+    long n = std::strtol(n_value, &end, 10);
+    if (type < 0 || *end != '\0' || end == n_value || n < 1 || n > (1L << 30))
+        return false;
+    p = Parameters(static_cast<Type>(type), n);
+
+    std::vector<const char*> fields = type_fields(p.type);
+    size_t known = 2;
+    for (size_t i = 0; i < fields.size(); i++) {
+        const char* value = find_value(words, fields[i]);
+        if (!value)
+            continue;
+        known++;
+        const char* value_end = value + std::strlen(value);
+        bool ok;
+        if (std::strcmp(fields[i], "hue-values") == 0) {
+            ok = parse_floats(value, value_end, hue_values);
+        } else if (std::strcmp(fields[i], "hue-positions") == 0) {
+            ok = parse_floats(value, value_end, hue_positions);
+        } else if (std::strcmp(fields[i], "color0") == 0) {
+            ok = parse_color(value, value_end, p.color0);
+        } else if (std::strcmp(fields[i], "color1") == 0) {
+            ok = parse_color(value, value_end, p.color1);
+        } else {
+            ok = false;
+            for (int j = 0; j < float_field_count; j++)
+                if (std::strcmp(fields[i], float_fields[j].name) == 0)
+                    ok = parse_float(value, value_end, &(p.*(float_fields[j].member)));
+        }
+        if (!ok)
+            return false;
+    }
+    // Reject unknown and duplicate words, which would otherwise be ignored
+    if (known != words.size())
+        return false;
+
+    if (find_value(words, "hue-values") || find_value(words, "hue-positions")) {
+        if (hue_values.size() != hue_positions.size() || hue_values.empty())
+            return false;
+        p.hues = hue_values.size();
+        p.hue_values = hue_values.data();
+        p.hue_positions = hue_positions.data();
+    }
+    return true;
+}
+
+template<typename T>
+int GenerateFromDefinition(const char* definition, int n, T* colormap)
+{
+    Parameters p;
+    std::vector<float> hue_values, hue_positions;
+    if (!ParseDefinition(definition, p, hue_values, hue_positions))
+        return -1;
+    if (n > 0)
+        p.n = n;
+    return Generate(p, colormap);
+}
+
+template int GenerateFromDefinition(const char*, int, unsigned char*);
+template int GenerateFromDefinition(const char*, int, unsigned short*);
+template int GenerateFromDefinition(const char*, int, float*);
+template int GenerateFromDefinition(const char*, int, half*);
+
+}
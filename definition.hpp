@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_DEFINITION_HPP
+#define COLORMAP_DEFINITION_HPP
+
+#include <string>
+#include <vector>
+
+#include "colormap.hpp"
+
+/* Color map definitions.
+ *
+ * A definition describes a color map independently of its resolution: it
+ * stores the type, the number of colors, and the parameters that the type
+ * uses, in a single line of text such as
+ *
+ *   gencolormap-definition 1 type=cubehelix n=256 hue=0x1.0c152ap-1 ...
+ *
+ * Floating point values are written in hexadecimal notation so that they are
+ * reproduced exactly, and angles are in radians as in Parameters. The control
+ * points of a color map are computed from these parameters, so a definition
+ * reproduces the color map exactly, and a client can generate it with any
+ * other number of colors instead of receiving all of them. Global settings
+ * such as SetExactBlackBody() are not part of a definition.
+ */
+
+namespace ColorMap {
+
+// The number of color map types
+constexpr int TypeCount = TypeDistinct + 1;
+
+// The name of a type as used in definitions and by the -t|--type option of
+// the gencolormap tool, e.g. "cubehelix"
+const char* TypeName(Type type);
+
+// The type with the given name, or -1 if there is none
+int ParseTypeName(const char* name);
+
+// The first word of each definition
+constexpr const char* DefinitionMagic = "gencolormap-definition";
+constexpr int DefinitionVersion = 1;
+
+// Get the definition of the color map, terminated by a newline
+std::string ToDefinition(const Parameters& parameters);
+
+// Parse a definition. Parameters that it does not contain get the defaults
+// of its type. The hue lists are stored in hue_values and hue_positions, and
+// the parameters point to them. Returns false if the definition is invalid.
+bool ParseDefinition(const char* definition, Parameters& parameters,
+        std::vector<float>& hue_values, std::vector<float>& hue_positions);
+
+// Generate the color map of a definition with n colors, or with the number
+// of colors of the definition if n is 0. The colormap must have room for
+// these colors. Returns the number of clipped colors, or -1 if the
+// definition is invalid.
+template<typename T>
+int GenerateFromDefinition(const char* definition, int n, T* colormap);
+
+}
+
+#endif
@@ -22,51 +22,690 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include "colormap.hpp"
+#include "archive.hpp"
 #include "export.hpp"
+#include "instrumentation.hpp"
 
 namespace ColorMap {
 
-std::string ToCSV(int n, const unsigned char* srgb_colormap)
+Writer::~Writer()
+{
+}
+
+bool FileWriter::write(const void* data, size_t size)
+{
+    return std::fwrite(data, 1, size, _f) == size;
+}
+
+bool StreamWriter::write(const void* data, size_t size)
+{
+    _os.write(static_cast<const char*>(data), size);
+    return _os.good();
+}
+
+bool StringWriter::write(const void* data, size_t size)
+{
+    _s.append(static_cast<const char*>(data), size);
+    return true;
+}
+
+bool CallbackWriter::write(const void* data, size_t size)
+{
+    return _func(_data, data, size);
+}
+
+/* A fixed size output buffer that passes full chunks to a writer */
+
+class buffer {
+private:
+    Writer& _writer;
+    size_t _len;
+    bool _ok;
+    char _buf[65536];
+
+public:
+    buffer(Writer& writer) : _writer(writer), _len(0), _ok(true)
+    {
+    }
+
+    bool flush()
+    {
+        if (_ok && _len > 0) {
+            _ok = _writer.write(_buf, _len);
+            Count(CounterExportBytes, _len);
+        }
+        _len = 0;
+        return _ok;
+    }
+
+    // Make room for at least size bytes (at most sizeof(_buf)) and return
+    // the write position; commit() the bytes actually used.
+    char* reserve(size_t size)
+    {
+        if (_len + size > sizeof(_buf))
+            flush();
+        return _buf + _len;
+    }
+
+    void commit(size_t size)
+    {
+        _len += size;
+    }
+
+    void put(const char* data, size_t size)
+    {
+        while (size > 0) {
+            size_t chunk = std::min(size, sizeof(_buf));
+            std::memcpy(reserve(chunk), data, chunk);
+            commit(chunk);
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    void put(const char* s)
+    {
+        put(s, std::strlen(s));
+    }
+
+    void put(char c)
+    {
+        *reserve(1) = c;
+        commit(1);
+    }
+
+    void put_uint(unsigned int v)
+    {
+        char tmp[10];
+        int i = sizeof(tmp);
+        do {
+            tmp[--i] = '0' + v % 10;
+            v /= 10;
+        } while (v > 0);
+        put(tmp + i, sizeof(tmp) - i);
+    }
+
+    // Same output as std::to_string(float)
+    void put_float(float v)
+    {
+        char* p = reserve(64);
+        commit(std::snprintf(p, 64, "%f", v));
+    }
+
+    void put_le32(uint32_t v)
+    {
+        char* p = reserve(4);
+        p[0] = v & 0xff;
+        p[1] = (v >> 8) & 0xff;
+        p[2] = (v >> 16) & 0xff;
+        p[3] = (v >> 24) & 0xff;
+        commit(4);
+    }
+
+    void put_be32(uint32_t v)
+    {
+        char* p = reserve(4);
+        p[0] = (v >> 24) & 0xff;
+        p[1] = (v >> 16) & 0xff;
+        p[2] = (v >> 8) & 0xff;
+        p[3] = v & 0xff;
+        commit(4);
+    }
+
+    void put_le64(uint64_t v)
+    {
+        put_le32(v & 0xffffffff);
+        put_le32(v >> 32);
+    }
+
+    void put_zeros(size_t size)
+    {
+        while (size > 0) {
+            size_t chunk = std::min(size, sizeof(_buf));
+            std::memset(reserve(chunk), 0, chunk);
+            commit(chunk);
+            size -= chunk;
+        }
+    }
+};
+
+static void export_csv(int n, const unsigned char* srgb_colormap, buffer& b)
 {
-    std::string s;
     for (int i = 0; i < n; i++) {
-        s +=  std::to_string(srgb_colormap[3 * i + 0]) + ", "
-            + std::to_string(srgb_colormap[3 * i + 1]) + ", "
-            + std::to_string(srgb_colormap[3 * i + 2]) + '\n';
+        b.put_uint(srgb_colormap[3 * i + 0]);
+        b.put(", ", 2);
+        b.put_uint(srgb_colormap[3 * i + 1]);
+        b.put(", ", 2);
+        b.put_uint(srgb_colormap[3 * i + 2]);
+        b.put('\n');
     }
-    return s;
 }
 
-std::string ToJSON(int n, const unsigned char* srgb_colormap)
+static void export_json(int n, const unsigned char* srgb_colormap, buffer& b)
 {
-    std::string s =
-        "[\n"
-        "{\n"
-        "\"ColorSpace\" : \"RGB\",\n"
-        "\"Name\" : \"GenColorMapGenerated\",\n"
-        "\"NanColor\" : [ -1, -1, -1 ],\n"
-        "\"RGBPoints\" : [\n";
+    // there are only 256 different component values, so format them once
+    static const std::vector<std::string> components = []() {
+        std::vector<std::string> c(256);
+        for (int i = 0; i < 256; i++)
+            c[i] = std::to_string(i / 255.0f);
+        return c;
+    }();
+    b.put("[\n"
+            "{\n"
+            "\"ColorSpace\" : \"RGB\",\n"
+            "\"Name\" : \"GenColorMapGenerated\",\n"
+            "\"NanColor\" : [ -1, -1, -1 ],\n"
+            "\"RGBPoints\" : [\n");
     for (int i = 0; i < n; i++) {
-        s +=  std::to_string(i / float(n - 1)) + ", "
-            + std::to_string(srgb_colormap[3 * i + 0] / 255.0f) + ", "
-            + std::to_string(srgb_colormap[3 * i + 1] / 255.0f) + ", "
-            + std::to_string(srgb_colormap[3 * i + 2] / 255.0f) + (i == n - 1 ? "\n" : ",\n");
+        b.put_float(n > 1 ? i / float(n - 1) : 0.0f);
+        for (int j = 0; j < 3; j++) {
+            const std::string& c = components[srgb_colormap[3 * i + j]];
+            b.put(", ", 2);
+            b.put(c.data(), c.size());
+        }
+        b.put(i == n - 1 ? "\n" : ",\n");
     }
-    s += "]\n}\n]\n";
-    return s;
+    b.put("]\n}\n]\n");
 }
 
-std::string ToPPM(int n, const unsigned char* srgb_colormap)
+static void export_ppm(int width, int height, const unsigned char* srgb_colormap, buffer& b)
 {
-    std::string s = "P3\n"; // magic number for plain PPM
-    s += std::to_string(n) + " 1\n"; // width and height
-    s += "255\n"; // max val
-    for (int i = 0; i < n; i++) {
-        s +=  std::to_string(srgb_colormap[3 * i + 0]) + ' '
-            + std::to_string(srgb_colormap[3 * i + 1]) + ' '
-            + std::to_string(srgb_colormap[3 * i + 2]) + '\n';
+    b.put("P3\n"); // magic number for plain PPM
+    b.put_uint(width);
+    b.put(' ');
+    b.put_uint(height);
+    b.put('\n');
+    b.put("255\n"); // max val
+    for (size_t i = 0; i < size_t(width) * height; i++) {
+        b.put_uint(srgb_colormap[3 * i + 0]);
+        b.put(' ');
+        b.put_uint(srgb_colormap[3 * i + 1]);
+        b.put(' ');
+        b.put_uint(srgb_colormap[3 * i + 2]);
+        b.put('\n');
+    }
+}
+
+static void export_ppm_binary(int width, int height, const unsigned char* srgb_colormap, buffer& b)
+{
+    b.put("P6\n"); // magic number for binary PPM
+    b.put_uint(width);
+    b.put(' ');
+    b.put_uint(height);
+    b.put('\n');
+    b.put("255\n"); // max val
+    b.put(reinterpret_cast<const char*>(srgb_colormap), 3 * size_t(width) * height);
+}
+
+/* PNG images without compression: the image data is a zlib stream of stored
+ * deflate blocks, so that no compression library is needed. Each deflate block
+ * gets its own IDAT chunk, so that the chunk lengths are known in advance. */
+
+static uint32_t crc32_update(uint32_t crc, const char* data, size_t size)
+{
+    static const std::vector<uint32_t> table = []() {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static uint32_t adler32_update(uint32_t adler, const char* data, size_t size)
+{
+    uint32_t s1 = adler & 0xffff;
+    uint32_t s2 = adler >> 16;
+    while (size > 0) {
+        // 5552 is the largest number of bytes before s2 can overflow
+        size_t chunk = std::min(size, size_t(5552));
+        for (size_t i = 0; i < chunk; i++) {
+            s1 += static_cast<unsigned char>(data[i]);
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+        data += chunk;
+        size -= chunk;
+    }
+    return (s2 << 16) | s1;
+}
+
+class png_chunk {
+private:
+    buffer& _b;
+    uint32_t _crc;
+
+public:
+    png_chunk(buffer& b, const char* type, uint32_t length) : _b(b), _crc(0xffffffffu)
+    {
+        _b.put_be32(length);
+        put(type, 4);
+    }
+
+    void put(const char* data, size_t size)
+    {
+        _b.put(data, size);
+        _crc = crc32_update(_crc, data, size);
+    }
+
+    void put_be32(uint32_t v)
+    {
+        char bytes[4] = {
+            static_cast<char>(v >> 24), static_cast<char>(v >> 16),
+            static_cast<char>(v >> 8), static_cast<char>(v)
+        };
+        put(bytes, 4);
+    }
+
+    void finish()
+    {
+        _b.put_be32(_crc ^ 0xffffffffu);
+    }
+};
+
+static void export_png(int width, int height, const unsigned char* srgb_colormap, buffer& b)
+{
+    b.put("\x89PNG\r\n\x1a\n", 8);
+    png_chunk ihdr(b, "IHDR", 13);
+    ihdr.put_be32(width);
+    ihdr.put_be32(height);
+    ihdr.put("\x08\x02\x00\x00\x00", 5); // 8 bit RGB, no interlacing
+    ihdr.finish();
+    png_chunk zlib_header(b, "IDAT", 2);
+    zlib_header.put("\x78\x01", 2);
+    zlib_header.finish();
+    // The scanlines, each starting with filter type 0 (none)
+    const char* pixels = reinterpret_cast<const char*>(srgb_colormap);
+    size_t row_size = 1 + 3 * size_t(width);
+    size_t size = row_size * height;
+    uint32_t adler = 1;
+    for (size_t offset = 0; offset < size; ) {
+        size_t block = std::min(size - offset, size_t(65535));
+        png_chunk idat(b, "IDAT", 5 + block);
+        char block_header[5] = {
+            static_cast<char>(offset + block == size ? 1 : 0),
+            static_cast<char>(block), static_cast<char>(block >> 8),
+            static_cast<char>(~block), static_cast<char>(~block >> 8)
+        };
+        idat.put(block_header, 5);
+        for (size_t end = offset + block; offset < end; ) {
+            size_t row = offset / row_size;
+            size_t column = offset % row_size;
+            const char* data = (column == 0 ? "" : pixels + row * (row_size - 1) + column - 1);
+            size_t length = (column == 0 ? 1 : std::min(row_size - column, end - offset));
+            idat.put(data, length);
+            adler = adler32_update(adler, data, length);
+            offset += length;
+        }
+        idat.finish();
+    }
+    png_chunk zlib_trailer(b, "IDAT", 4);
+    zlib_trailer.put_be32(adler);
+    zlib_trailer.finish();
+    png_chunk iend(b, "IEND", 0);
+    iend.finish();
+}
+
+static void put_float_le32(float v, buffer& b)
+{
+    uint32_t u;
+    std::memcpy(&u, &v, sizeof(u));
+    b.put_le32(u);
+}
+
+static void export_raw_rgb32f(int n, const unsigned char* srgb_colormap, buffer& b)
+{
+    for (size_t i = 0; i < 3 * size_t(n); i++)
+        put_float_le32(srgb_colormap[i] / 255.0f, b);
+}
+
+static void export_cmap(int n, const unsigned char* srgb_colormap, buffer& b)
+{
+    b.put("GCMAP\0\0\0", 8);
+    b.put_le32(1); // version
+    b.put_le32(n);
+    b.put(reinterpret_cast<const char*>(srgb_colormap), 3 * size_t(n));
+}
+
+bool Export(Format format, int n, const unsigned char* srgb_colormap, Writer& writer)
+{
+    StageTimer timer(StageExport);
+    buffer b(writer);
+    switch (format) {
+    case FormatCSV:
+        export_csv(n, srgb_colormap, b);
+        break;
+    case FormatJSON:
+        export_json(n, srgb_colormap, b);
+        break;
+    case FormatPPM:
+        export_ppm(n, 1, srgb_colormap, b);
+        break;
+    case FormatPPMBinary:
+        export_ppm_binary(n, 1, srgb_colormap, b);
+        break;
+    case FormatRawRGB8:
+        b.put(reinterpret_cast<const char*>(srgb_colormap), 3 * size_t(n));
+        break;
+    case FormatRawRGB32F:
+        export_raw_rgb32f(n, srgb_colormap, b);
+        break;
+    case FormatCMap:
+        export_cmap(n, srgb_colormap, b);
+        break;
+    case FormatPNG:
+        export_png(n, 1, srgb_colormap, b);
+        break;
+    }
+    return b.flush();
+}
+
+bool ExportRawRGB32F(int n, const float* srgb_colormap, Writer& writer)
+{
+    StageTimer timer(StageExport);
+    buffer b(writer);
+    for (size_t i = 0; i < 3 * size_t(n); i++)
+        put_float_le32(srgb_colormap[i], b);
+    return b.flush();
+}
+
+/* Atlases */
+
+int AtlasWidth(int count, const Parameters* parameters)
+{
+    int n = 1;
+    for (int i = 0; i < count; i++)
+        n = std::max(n, parameters[i].n);
+    int width = 1;
+    while (width < n)
+        width *= 2;
+    return width;
+}
+
+template<typename T>
+struct atlas_job {
+    const Parameters* parameters;
+    int width;
+    T* atlas;
+    int* clipped;
+};
+
+template<typename T>
+static void generate_atlas_rows(void* data, int begin, int end)
+{
+    const atlas_job<T>* j = static_cast<const atlas_job<T>*>(data);
+    for (int i = begin; i < end; i++) {
+        int n = j->parameters[i].n;
+        T* row = j->atlas + 3 * size_t(j->width) * i;
+        j->clipped[i] = Generate(j->parameters[i], row);
+        for (int k = n; k < j->width; k++)
+            std::copy(row + 3 * (n - 1), row + 3 * n, row + 3 * k);
+    }
+}
+
+template<typename T>
+int GenerateAtlas(int count, const Parameters* parameters, int width, T* atlas, int* clipped)
+{
+    std::vector<int> row_clipped(count);
+    atlas_job<T> j = { parameters, width, atlas, row_clipped.data() };
+    ParallelFor(count, 1, generate_atlas_rows<T>, &j);
+    int total_clipped = 0;
+    for (int i = 0; i < count; i++) {
+        if (clipped)
+            clipped[i] = row_clipped[i];
+        total_clipped += row_clipped[i];
+    }
+    return total_clipped;
+}
+
+template int GenerateAtlas(int, const Parameters*, int, unsigned char*, int*);
+template int GenerateAtlas(int, const Parameters*, int, float*, int*);
+
+bool ExportAtlas(Format format, int width, int height, const unsigned char* srgb_atlas, Writer& writer)
+{
+    StageTimer timer(StageExport);
+    buffer b(writer);
+    switch (format) {
+    case FormatPPM:
+        export_ppm(width, height, srgb_atlas, b);
+        break;
+    case FormatPPMBinary:
+        export_ppm_binary(width, height, srgb_atlas, b);
+        break;
+    case FormatPNG:
+        export_png(width, height, srgb_atlas, b);
+        break;
+    case FormatRawRGB8:
+        b.put(reinterpret_cast<const char*>(srgb_atlas), 3 * size_t(width) * height);
+        break;
+    case FormatRawRGB32F:
+        export_raw_rgb32f(width * height, srgb_atlas, b);
+        break;
+    default:
+        return false;
     }
+    return b.flush();
+}
+
+static void put_json_string(const char* s, buffer& b)
+{
+    b.put('"');
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            b.put('\\');
+            b.put(*s);
+        } else if (c < 0x20) {
+            char* p = b.reserve(7);
+            b.commit(std::snprintf(p, 7, "\\u%04x", c));
+        } else {
+            b.put(*s);
+        }
+    }
+    b.put('"');
+}
+
+static void put_json_number(double v, buffer& b)
+{
+    char* p = b.reserve(32);
+    b.commit(std::snprintf(p, 32, "%.9g", v));
+}
+
+bool ExportAtlasIndex(int count, const char* const* names, const Parameters* parameters, int width,
+        Writer& writer)
+{
+    buffer b(writer);
+    b.put("{\n\"width\" : ");
+    b.put_uint(width);
+    b.put(",\n\"height\" : ");
+    b.put_uint(count);
+    b.put(",\n\"maps\" : [\n");
+    for (int i = 0; i < count; i++) {
+        int n = parameters[i].n;
+        b.put("{ \"name\" : ");
+        if (names) {
+            put_json_string(names[i], b);
+        } else {
+            b.put('"');
+            b.put_uint(i + 1);
+            b.put('"');
+        }
+        b.put(", \"row\" : ");
+        b.put_uint(i);
+        b.put(", \"n\" : ");
+        b.put_uint(n);
+        b.put(", \"u0\" : ");
+        put_json_number(0.5 / width, b);
+        b.put(", \"u1\" : ");
+        put_json_number((n - 0.5) / width, b);
+        b.put(", \"v\" : ");
+        put_json_number((i + 0.5) / count, b);
+        b.put(i == count - 1 ? " }\n" : " },\n");
+    }
+    b.put("]\n}\n");
+    return b.flush();
+}
+
+/* Archives */
+
+static uint64_t align64(uint64_t offset)
+{
+    return (offset + 63) / 64 * 64;
+}
+
+// Insert entry index i into a hash table with linear probing
+static void table_insert(std::vector<uint32_t>& table, uint64_t hash, uint32_t i)
+{
+    uint32_t mask = table.size() - 1;
+    uint32_t j = hash & mask;
+    while (table[j] != 0)
+        j = (j + 1) & mask;
+    table[j] = i + 1;
+}
+
+// Write an archive from either 8 bit or float color maps; the other payload
+// is derived from the given one
+static bool write_archive(int count, const char* const* names, const Parameters* parameters,
+        const unsigned char* srgb_colormaps, const float* float_srgb_colormaps, Writer& writer)
+{
+    StageTimer timer(StageExport);
+    uint32_t table_size = 2;
+    while (table_size < 2 * uint32_t(count))
+        table_size *= 2;
+
+    // Compute the layout
+    std::vector<ArchiveEntry> entries(count);
+    std::vector<uint32_t> name_table(table_size, 0);
+    std::vector<uint32_t> hash_table(table_size, 0);
+    uint64_t entries_offset = sizeof(ArchiveHeader);
+    uint64_t name_table_offset = entries_offset + count * sizeof(ArchiveEntry);
+    uint64_t hash_table_offset = name_table_offset + table_size * sizeof(uint32_t);
+    uint64_t names_offset = hash_table_offset + table_size * sizeof(uint32_t);
+    uint64_t names_size = 0;
+    for (int i = 0; i < count; i++) {
+        ArchiveEntry& e = entries[i];
+        e.parameter_hash = Hash(parameters[i]);
+        e.name_offset = names_size;
+        e.name_length = std::strlen(names[i]);
+        e.n = parameters[i].n;
+        e.reserved = 0;
+        names_size += e.name_length + 1;
+        table_insert(name_table, ArchiveNameHash(names[i], e.name_length), i);
+        table_insert(hash_table, e.parameter_hash, i);
+    }
+    uint64_t offset = align64(names_offset + names_size);
+    for (int i = 0; i < count; i++) {
+        entries[i].srgb_offset = offset;
+        offset = align64(offset + 3 * uint64_t(entries[i].n));
+        entries[i].srgb_float_offset = offset;
+        offset = align64(offset + 3 * uint64_t(entries[i].n) * sizeof(float));
+    }
+    uint64_t file_size = offset;
+
+    // Write the file sequentially
+    buffer b(writer);
+    b.put(ArchiveMagic, sizeof(ArchiveMagic));
+    b.put_le32(ArchiveByteOrder);
+    b.put_le32(ArchiveVersion);
+    b.put_le32(count);
+    b.put_le32(table_size);
+    b.put_le64(entries_offset);
+    b.put_le64(name_table_offset);
+    b.put_le64(hash_table_offset);
+    b.put_le64(names_offset);
+    b.put_le64(file_size);
+    for (int i = 0; i < count; i++) {
+        const ArchiveEntry& e = entries[i];
+        b.put_le64(e.parameter_hash);
+        b.put_le32(e.name_offset);
+        b.put_le32(e.name_length);
+        b.put_le32(e.n);
+        b.put_le32(e.reserved);
+        b.put_le64(e.srgb_offset);
+        b.put_le64(e.srgb_float_offset);
+    }
+    for (uint32_t i = 0; i < table_size; i++)
+        b.put_le32(name_table[i]);
+    for (uint32_t i = 0; i < table_size; i++)
+        b.put_le32(hash_table[i]);
+    for (int i = 0; i < count; i++)
+        b.put(names[i], entries[i].name_length + 1);
+    b.put_zeros(align64(names_offset + names_size) - (names_offset + names_size));
+    const unsigned char* colormap = srgb_colormaps;
+    const float* float_colormap = float_srgb_colormaps;
+    for (int i = 0; i < count; i++) {
+        uint64_t n = entries[i].n;
+        if (colormap) {
+            b.put(reinterpret_cast<const char*>(colormap), 3 * n);
+        } else {
+            // the float values are clamped to [0,1]
+            for (uint64_t j = 0; j < 3 * n; j++) {
+                unsigned char v = std::round(float_colormap[j] * 255.0f);
+                b.put(char(v));
+            }
+        }
+        b.put_zeros(entries[i].srgb_float_offset - (entries[i].srgb_offset + 3 * n));
+        if (colormap) {
+            export_raw_rgb32f(n, colormap, b);
+            colormap += 3 * n;
+        } else {
+            for (uint64_t j = 0; j < 3 * n; j++)
+                put_float_le32(float_colormap[j], b);
+            float_colormap += 3 * n;
+        }
+        uint64_t end = entries[i].srgb_float_offset + 3 * n * sizeof(float);
+        b.put_zeros(align64(end) - end);
+    }
+    return b.flush();
+}
+
+bool WriteArchive(int count, const char* const* names, const Parameters* parameters,
+        const unsigned char* srgb_colormaps, Writer& writer)
+{
+    return write_archive(count, names, parameters, srgb_colormaps, NULL, writer);
+}
+
+bool WriteArchive(int count, const char* const* names, const Parameters* parameters,
+        const float* srgb_colormaps, Writer& writer)
+{
+    return write_archive(count, names, parameters, NULL, srgb_colormaps, writer);
+}
+
+static std::string to_string(Format format, int n, const unsigned char* srgb_colormap)
+{
+    std::string s;
+    StringWriter writer(s);
+    Export(format, n, srgb_colormap, writer);
     return s;
 }
 
+std::string ToCSV(int n, const unsigned char* srgb_colormap)
+{
+    return to_string(FormatCSV, n, srgb_colormap);
+}
+
+std::string ToJSON(int n, const unsigned char* srgb_colormap)
+{
+    return to_string(FormatJSON, n, srgb_colormap);
+}
+
+std::string ToPPM(int n, const unsigned char* srgb_colormap)
+{
+    return to_string(FormatPPM, n, srgb_colormap);
+}
+
 }
@@ -26,9 +26,141 @@
 #define COLORMAP_EXPORT_HPP
 
 #include <string>
+#include <ostream>
+#include <cstdio>
+#include <cstddef>
 
 namespace ColorMap {
 
+struct Parameters;
+
+/*
+ * Writers receive the exported data in chunks.
+ */
+
+class Writer {
+public:
+    virtual ~Writer();
+    // Write size bytes. Returns false on error.
+    virtual bool write(const void* data, size_t size) = 0;
+};
+
+// Write to a FILE* that stays open, e.g. stdout
+class FileWriter : public Writer {
+private:
+    FILE* _f;
+public:
+    FileWriter(FILE* f) : _f(f) {}
+    bool write(const void* data, size_t size) override;
+};
+
+// Write to a std::ostream
+class StreamWriter : public Writer {
+private:
+    std::ostream& _os;
+public:
+    StreamWriter(std::ostream& os) : _os(os) {}
+    bool write(const void* data, size_t size) override;
+};
+
+// Append to a std::string
+class StringWriter : public Writer {
+private:
+    std::string& _s;
+public:
+    StringWriter(std::string& s) : _s(s) {}
+    bool write(const void* data, size_t size) override;
+};
+
+// Call func(data, chunk, size) for each chunk; func returns false on error
+class CallbackWriter : public Writer {
+private:
+    bool (*_func)(void* data, const void* chunk, size_t size);
+    void* _data;
+public:
+    CallbackWriter(bool (*func)(void* data, const void* chunk, size_t size), void* data) :
+        _func(func), _data(data) {}
+    bool write(const void* data, size_t size) override;
+};
+
+/*
+ * Export formats.
+ *
+ * The binary formats store the colors in the order red, green, blue:
+ * - FormatRawRGB8: one unsigned byte per component
+ * - FormatRawRGB32F: one little endian IEEE 754 float in [0,1] per component
+ * - FormatCMap: the header "GCMAP\0\0\0", followed by the format version (1)
+ *   and the number of colors n as little endian 32 bit unsigned integers,
+ *   followed by n colors as in FormatRawRGB8
+ * - FormatPNG: an uncompressed 8 bit RGB PNG image
+ */
+
+enum Format {
+    FormatCSV,          // plain text, one color per line
+    FormatJSON,         // ParaView color map
+    FormatPPM,          // plain PPM image (P3) with n x 1 pixels
+    FormatPPMBinary,    // binary PPM image (P6) with n x 1 pixels
+    FormatRawRGB8,      // raw 8 bit sRGB values
+    FormatRawRGB32F,    // raw 32 bit float sRGB values
+    FormatCMap,         // small header followed by raw 8 bit sRGB values
+    FormatPNG           // PNG image with n x 1 pixels
+};
+
+// Write a color map with n sRGB triplets in the given format. The output is
+// formatted in a fixed size buffer and passed to the writer in chunks.
+// Returns false if the writer fails.
+bool Export(Format format, int n, const unsigned char* srgb_colormap, Writer& writer);
+
+// Write a color map with n float sRGB triplets in FormatRawRGB32F. Together
+// with the float versions of the generator functions, this avoids the 8 bit
+// quantization. Returns false if the writer fails.
+bool ExportRawRGB32F(int n, const float* srgb_colormap, Writer& writer);
+
+// Write count color maps as an archive (see archive.hpp). The color maps are
+// stored one after the other in srgb_colormaps, as generated by the batch
+// version of Generate(). The names must be unique. Returns false if the writer
+// fails.
+// With 8 bit color maps, the float payload of the archive only holds the
+// quantized values; generate float color maps to keep their full precision.
+// The 8 bit payload is then quantized from them.
+bool WriteArchive(int count, const char* const* names, const Parameters* parameters,
+        const unsigned char* srgb_colormaps, Writer& writer);
+bool WriteArchive(int count, const char* const* names, const Parameters* parameters,
+        const float* srgb_colormaps, Writer& writer);
+
+/*
+ * Atlases.
+ *
+ * An atlas stores many color maps in one image, so that a renderer can use
+ * them all through a single texture. Row i of the atlas holds color map i. The
+ * atlas width is the same for all rows; shorter color maps are padded by
+ * repeating their last color, so that linear texture filtering never mixes
+ * colors of different maps. The index lists the color maps and their texture
+ * coordinates: sample color map i at t in [0,1] at (u0 + t * (u1 - u0), v).
+ */
+
+// The smallest power of two that is at least as large as each color map
+int AtlasWidth(int count, const Parameters* parameters);
+
+// Generate count color maps into an atlas with width * count sRGB triplets,
+// in parallel (see SetThreads() in colormap.hpp). The width must be at least
+// as large as each color map. Returns the total number of clipped colors, and
+// the number per color map in clipped if it is not NULL.
+template<typename T>
+int GenerateAtlas(int count, const Parameters* parameters, int width, T* srgb_atlas, int* clipped = NULL);
+
+// Write an atlas with width x height sRGB triplets as an image in FormatPPM,
+// FormatPPMBinary, FormatPNG, FormatRawRGB8, or FormatRawRGB32F. For float
+// atlases, use ExportRawRGB32F() with width * height colors. Returns false
+// for other formats or if the writer fails.
+bool ExportAtlas(Format format, int width, int height, const unsigned char* srgb_atlas, Writer& writer);
+
+// Write the index of an atlas with the given color maps and width in JSON
+// format. If names is NULL, the color maps are named by their number.
+// Returns false if the writer fails.
+bool ExportAtlasIndex(int count, const char* const* names, const Parameters* parameters, int width,
+        Writer& writer);
+
 // Convert a color map with n sRGB triplets to CSV format
 std::string ToCSV(int n, const unsigned char* srgb_colormap);
 
@@ -37,14 +37,85 @@
 #include <QMessageBox>
 #include <QRadioButton>
 #include <QButtonGroup>
+#include <QRunnable>
 
 #include "colormapwidgets.hpp"
 #include "testwidget.hpp"
+#include "colormap.hpp"
 #include "export.hpp"
 
 
-GUI::GUI()
+/* The worker job that generates the color map and renders its previews.
+ * It checks between the steps whether its parameters are still current. */
+class GUIUpdateJob : public QRunnable
 {
+private:
+    QObject* _receiver;
+    const QAtomicInt* _current_generation;
+    int _generation;
+    ColorMap::Evaluator* _evaluator;
+    int _colormap_img_width, _colormap_img_height;
+    int _test_img_width, _test_img_height;
+
+    bool stale() const
+    {
+        return _current_generation->loadAcquire() != _generation;
+    }
+
+    void finish(int clipped, const QImage& colormap_img, const QImage& test_img)
+    {
+        QMetaObject::invokeMethod(_receiver, "updateFinished", Qt::QueuedConnection,
+                Q_ARG(int, _generation), Q_ARG(int, clipped),
+                Q_ARG(QImage, colormap_img), Q_ARG(QImage, test_img));
+    }
+
+public:
+    GUIUpdateJob(QObject* receiver, const QAtomicInt* current_generation, int generation,
+            ColorMap::Evaluator* evaluator,
+            int colormap_img_width, int colormap_img_height,
+            int test_img_width, int test_img_height) :
+        _receiver(receiver), _current_generation(current_generation), _generation(generation),
+        _evaluator(evaluator),
+        _colormap_img_width(colormap_img_width), _colormap_img_height(colormap_img_height),
+        _test_img_width(test_img_width), _test_img_height(test_img_height)
+    {
+    }
+
+    ~GUIUpdateJob()
+    {
+        delete _evaluator;
+    }
+
+    void run() override
+    {
+        if (stale()) {
+            finish(0, QImage(), QImage());
+            return;
+        }
+        QVector<unsigned char> colormap(3 * _evaluator->parameters().n);
+        int clipped = _evaluator->Fill(colormap.data());
+        if (stale()) {
+            finish(0, QImage(), QImage());
+            return;
+        }
+        QImage colormap_img = ColorMapWidget::colorMapImage(colormap, _colormap_img_width, _colormap_img_height);
+        if (stale()) {
+            finish(0, QImage(), QImage());
+            return;
+        }
+        QImage test_img = ColorMapTestWidget::testImage(colormap, _test_img_width, _test_img_height);
+        finish(clipped, colormap_img, test_img);
+    }
+};
+
+
+GUI::GUI() :
+    _update_generation(0),
+    _update_running(false),
+    _update_pending(false)
+{
+    _update_pool.setMaxThreadCount(1);
+
     setWindowTitle("Generate Color Map");
     setWindowIcon(QIcon(":cg-logo.png"));
 
@@ -207,6 +278,8 @@ GUI::GUI()
 
 GUI::~GUI()
 {
+    _update_generation.ref();
+    _update_pool.waitForDone();
 }
 
 ColorMapWidget* GUI::currentWidget()
@@ -218,11 +291,34 @@ ColorMapWidget* GUI::currentWidget()
 void GUI::update()
 {
     _reference_label->setText(currentWidget()->reference());
-    int clipped;
-    QVector<unsigned char> colormap = currentWidget()->colorMap(&clipped);
-    _clipped_label->setText(QString("Colors clipped: %1").arg(clipped));
-    _colormap_label->setPixmap(QPixmap::fromImage(currentWidget()->colorMapImage(colormap, 32, _colormap_label->height())));
-    _test_widget->update(colormap);
+    _update_generation.ref();
+    if (_update_running)
+        _update_pending = true;
+    else
+        startUpdate();
+}
+
+void GUI::startUpdate()
+{
+    _update_running = true;
+    _update_pool.start(new GUIUpdateJob(this, &_update_generation, _update_generation.loadAcquire(),
+                currentWidget()->colorMapEvaluator(),
+                32, _colormap_label->height(),
+                ColorMapTestWidget::imageWidth(), ColorMapTestWidget::imageHeight()));
+}
+
+void GUI::updateFinished(int generation, int clipped, const QImage& colormap_img, const QImage& test_img)
+{
+    _update_running = false;
+    if (generation == _update_generation.loadAcquire() && !test_img.isNull()) {
+        _clipped_label->setText(QString("Colors clipped: %1").arg(clipped));
+        _colormap_label->setPixmap(QPixmap::fromImage(colormap_img));
+        _test_widget->setImage(test_img);
+    }
+    if (_update_pending) {
+        _update_pending = false;
+        startUpdate();
+    }
 }
 
 void GUI::file_export()
@@ -26,6 +26,9 @@
 #define GUI_HPP
 
 #include <QMainWindow>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QImage>
 
 class ColorMapWidget;
 class ColorMapBrewerSequentialWidget;
@@ -84,10 +87,22 @@ private:
     QRadioButton* _export_format_csv_button;
     QRadioButton* _export_format_json_button;
 
+    /* Color map generation and preview rendering run in a worker thread.
+     * Every change increments the generation counter, which makes running
+     * jobs for older parameters stop early. At most one job runs at a time;
+     * changes that arrive meanwhile are coalesced into a single new job for
+     * the latest parameters once the running job has finished. */
+    QThreadPool _update_pool;
+    QAtomicInt _update_generation;
+    bool _update_running;
+    bool _update_pending;
+
     ColorMapWidget* currentWidget();
+    void startUpdate();
 
 private slots:
     void update();
+    void updateFinished(int generation, int clipped, const QImage& colormap_img, const QImage& test_img);
 
     void file_export();
     void edit_reset();
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+
+#include "instrumentation.hpp"
+
+namespace ColorMap {
+
+static const char* stage_names[StageCount] = {
+    "generate", "setup", "evaluate", "convert", "export"
+};
+
+static const char* counter_names[CounterCount] = {
+    "maps", "entries", "clipped", "cache-hits", "cache-misses", "export-bytes"
+};
+
+const char* StageName(Stage stage)
+{
+    return stage_names[stage];
+}
+
+const char* CounterName(Counter counter)
+{
+    return counter_names[counter];
+}
+
+std::atomic<bool> instrumentation_enabled(false);
+static std::atomic<bool> tracing_enabled(false);
+
+static std::atomic<unsigned long long> stage_calls[StageCount];
+static std::atomic<unsigned long long> stage_nanoseconds[StageCount];
+static std::atomic<unsigned long long> counters[CounterCount];
+static std::atomic<unsigned long long> dropped_trace_events(0);
+
+// The clock is in nanoseconds since the last reset
+static long long steady_nanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::atomic<long long> epoch(steady_nanoseconds());
+
+long long InstrumentationClock()
+{
+    return steady_nanoseconds() - epoch.load(std::memory_order_relaxed);
+}
+
+/* Trace events, in the order in which they ended. Threads are numbered in
+ * the order in which they record their first event. */
+
+struct trace_event {
+    int stage;
+    int thread;
+    long long begin;
+    long long duration;
+};
+
+static std::mutex trace_mutex;
+static std::vector<trace_event> trace_events;
+static std::atomic<int> trace_threads(0);
+
+static int trace_thread()
+{
+    static thread_local int thread = -1;
+    if (thread < 0)
+        thread = trace_threads.fetch_add(1, std::memory_order_relaxed);
+    return thread;
+}
+
+void RecordStage(Stage stage, long long begin)
+{
+    long long duration = InstrumentationClock() - begin;
+    stage_calls[stage].fetch_add(1, std::memory_order_relaxed);
+    stage_nanoseconds[stage].fetch_add(duration, std::memory_order_relaxed);
+    if (tracing_enabled.load(std::memory_order_relaxed)) {
+        trace_event e = { stage, trace_thread(), begin, duration };
+        std::lock_guard<std::mutex> lock(trace_mutex);
+        if (trace_events.size() < size_t(TraceCapacity))
+            trace_events.push_back(e);
+        else
+            dropped_trace_events.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RecordCounter(Counter counter, unsigned long long value)
+{
+    counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+void SetInstrumentation(bool enabled)
+{
+#ifdef GENCOLORMAP_INSTRUMENTATION
+    instrumentation_enabled = enabled || tracing_enabled;
+#else
+    (void)enabled;
+#endif
+}
+
+bool Instrumentation()
+{
+    return instrumentation_enabled;
+}
+
+void SetTracing(bool enabled)
+{
+#ifdef GENCOLORMAP_INSTRUMENTATION
+    tracing_enabled = enabled;
+    if (enabled)
+        instrumentation_enabled = true;
+#else
+    (void)enabled;
+#endif
+}
+
+bool Tracing()
+{
+    return tracing_enabled;
+}
+
+Statistics GetStatistics()
+{
+    Statistics s;
+    for (int i = 0; i < StageCount; i++) {
+        s.calls[i] = stage_calls[i];
+        s.seconds[i] = stage_nanoseconds[i] * 1e-9;
+    }
+    for (int i = 0; i < CounterCount; i++)
+        s.counters[i] = counters[i];
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    s.trace_events = trace_events.size();
+    s.dropped_trace_events = dropped_trace_events;
+    return s;
+}
+
+void ResetStatistics()
+{
+    for (int i = 0; i < StageCount; i++) {
+        stage_calls[i] = 0;
+        stage_nanoseconds[i] = 0;
+    }
+    for (int i = 0; i < CounterCount; i++)
+        counters[i] = 0;
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_events.clear();
+    dropped_trace_events = 0;
+    epoch = steady_nanoseconds();
+}
+
+std::string StatisticsToText(const Statistics& s)
+{
+    std::string text;
+    char line[128];
+    for (int i = 0; i < StageCount; i++) {
+        std::snprintf(line, sizeof(line), "%-14s %12llu calls %14.6f s\n",
+                stage_names[i], s.calls[i], s.seconds[i]);
+        text += line;
+    }
+    for (int i = 0; i < CounterCount; i++) {
+        std::snprintf(line, sizeof(line), "%-14s %12llu\n", counter_names[i], s.counters[i]);
+        text += line;
+    }
+    if (s.trace_events > 0 || s.dropped_trace_events > 0) {
+        std::snprintf(line, sizeof(line), "%-14s %12llu events, %llu dropped\n",
+                "trace", s.trace_events, s.dropped_trace_events);
+        text += line;
+    }
+    return text;
+}
+
+std::string TraceToJSON()
+{
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    std::string json = "{\"traceEvents\":[";
+    char event[192];
+    for (size_t i = 0; i < trace_events.size(); i++) {
+        const trace_event& e = trace_events[i];
+        std::snprintf(event, sizeof(event),
+                "%s\n{\"name\":\"%s\",\"cat\":\"gencolormap\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%.3f,\"dur\":%.3f}",
+                i > 0 ? "," : "", stage_names[e.stage], e.thread,
+                e.begin * 1e-3, e.duration * 1e-3);
+        json += event;
+    }
+    json += "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return json;
+}
+
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_INSTRUMENTATION_HPP
+#define COLORMAP_INSTRUMENTATION_HPP
+
+#include <atomic>
+#include <string>
+
+/* Instrumentation.
+ *
+ * The library can measure where the time goes when color maps are generated
+ * and exported: each stage has a timer that sums up its calls and their
+ * duration, and counters record the amount of work done. With tracing, each
+ * timed call is also recorded as an event, and the events can be written in
+ * the Chrome trace event format for chrome://tracing or Perfetto.
+ *
+ * Instrumentation is disabled by default. Disabled timers and counters cost
+ * one relaxed atomic load. The hooks only exist if the library is built with
+ * GENCOLORMAP_INSTRUMENTATION defined, which the CMake option of the same name
+ * does; otherwise they are compiled out completely and Instrumentation()
+ * stays false. A copy of colormap.cpp used on its own has no hooks.
+ *
+ * The stage times are summed over all threads, so with several threads they
+ * can exceed the wall clock time. The stages nest: generating a color map
+ * includes its setup, evaluation and conversion.
+ */
+
+namespace ColorMap {
+
+enum Stage {
+    StageGenerate,      // Generate(): one complete color map
+    StageSetup,         // computing the control points of a color map
+    StageEvaluate,      // computing a block of colors in their native color space
+    StageConvert,       // converting a block of colors to sRGB and quantizing them
+    StageExport,        // formatting a color map for output
+    StageCount
+};
+
+enum Counter {
+    CounterMaps,        // color maps generated by Generate()
+    CounterEntries,     // colors generated, by all functions
+    CounterClipped,     // colors that had to be clipped
+    CounterCacheHits,   // ResultCache lookups that found a result
+    CounterCacheMisses, // ResultCache lookups that did not
+    CounterExportBytes, // bytes passed to writers by the export functions
+    CounterCount
+};
+
+// The names of stages and counters, e.g. "evaluate" or "cache-hits"
+const char* StageName(Stage stage);
+const char* CounterName(Counter counter);
+
+// Enable or disable instrumentation. Enabling tracing also enables
+// instrumentation. Tracing keeps at most TraceCapacity events; later ones
+// are only counted in the statistics.
+void SetInstrumentation(bool enabled);
+bool Instrumentation();
+void SetTracing(bool enabled);
+bool Tracing();
+constexpr int TraceCapacity = 1 << 20;
+
+struct Statistics {
+    unsigned long long calls[StageCount];
+    double seconds[StageCount];
+    unsigned long long counters[CounterCount];
+    unsigned long long trace_events;
+    unsigned long long dropped_trace_events;
+};
+
+// Get the statistics since the last reset, and reset the statistics and the
+// recorded trace events. Do not reset while color maps are generated.
+Statistics GetStatistics();
+void ResetStatistics();
+
+// Format statistics as a human readable table
+std::string StatisticsToText(const Statistics& statistics);
+
+// Write the recorded trace events in the Chrome trace event format (JSON).
+// Times are in microseconds since the last reset.
+std::string TraceToJSON();
+
+/* Hooks for the library code. A StageTimer times the scope it lives in. */
+
+extern std::atomic<bool> instrumentation_enabled; // use SetInstrumentation()
+long long InstrumentationClock();
+void RecordStage(Stage stage, long long begin);
+void RecordCounter(Counter counter, unsigned long long value);
+
+#ifdef GENCOLORMAP_INSTRUMENTATION
+
+class StageTimer {
+private:
+    Stage _stage;
+    long long _begin;
+
+public:
+    explicit StageTimer(Stage stage) : _stage(stage),
+        _begin(instrumentation_enabled.load(std::memory_order_relaxed) ? InstrumentationClock() : -1)
+    {
+    }
+
+    ~StageTimer()
+    {
+        if (_begin >= 0)
+            RecordStage(_stage, _begin);
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+inline void Count(Counter counter, unsigned long long value)
+{
+    if (instrumentation_enabled.load(std::memory_order_relaxed))
+        RecordCounter(counter, value);
+}
+
+#else
+
+class StageTimer {
+public:
+    explicit StageTimer(Stage)
+    {
+    }
+};
+
+inline void Count(Counter, unsigned long long)
+{
+}
+
+#endif
+
+}
+
+#endif
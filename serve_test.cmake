@@ -0,0 +1,42 @@
+# Copyright (C) 2015, 2016, 2017, 2018, 2019
+# Computer Graphics Group, University of Siegen
+# Written by Martin Lambers <martin.lambers@uni-siegen.de>
+#
+# Copying and distribution of this file, with or without modification, are
+# permitted in any medium without royalty provided the copyright notice and this
+# notice are preserved. This file is offered as-is, without any warranty.
+
+# Check that pipelined requests in server mode do not see the options of
+# earlier requests that used the same slot of the request ring buffer of 64
+# requests.
+# Usage: cmake -DGENCOLORMAP=<path> -DWORKDIR=<dir> -P serve_test.cmake
+
+set(last "-t pusequential-multihue -n 4\n")
+set(requests "-t pusequential-multihue -n 4 -V 10,200 --hue-positions=0,1\n")
+foreach(i RANGE 2 64)
+	string(APPEND requests "-n 2\n")
+endforeach()
+string(APPEND requests "${last}")
+file(WRITE "${WORKDIR}/serve_test_requests" "${requests}")
+file(WRITE "${WORKDIR}/serve_test_last" "${last}")
+
+execute_process(COMMAND "${GENCOLORMAP}" --serve
+	INPUT_FILE "${WORKDIR}/serve_test_requests"
+	OUTPUT_VARIABLE responses RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "gencolormap --serve failed")
+endif()
+execute_process(COMMAND "${GENCOLORMAP}" --serve
+	INPUT_FILE "${WORKDIR}/serve_test_last"
+	OUTPUT_VARIABLE expected RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "gencolormap --serve failed")
+endif()
+
+string(LENGTH "${responses}" responses_length)
+string(LENGTH "${expected}" expected_length)
+math(EXPR begin "${responses_length} - ${expected_length}")
+string(SUBSTRING "${responses}" ${begin} -1 response)
+if(NOT response STREQUAL expected)
+	message(FATAL_ERROR "last response differs:\n${response}\nexpected:\n${expected}")
+endif()
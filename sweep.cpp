@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <vector>
+#include <cmath>
+#include <climits>
+
+#include "sweep.hpp"
+#include "analysis.hpp"
+
+namespace ColorMap {
+
+int SweepPoints(int ranges, const SweepRange* range)
+{
+    long long points = 1;
+    for (int r = 0; r < ranges; r++) {
+        if (range[r].steps < 1)
+            return -1;
+        points *= range[r].steps;
+        if (points > INT_MAX)
+            return -1;
+    }
+    return points;
+}
+
+static float* sweep_field(Parameters& p, SweepParameter parameter)
+{
+    switch (parameter) {
+    case SweepHue:
+        return &p.hue;
+    case SweepDivergence:
+        return &p.divergence;
+    case SweepContrast:
+        return &p.contrast;
+    case SweepSaturation:
+        return &p.saturation;
+    case SweepSaturationRange:
+        return &p.saturation_range;
+    case SweepBrightness:
+        return &p.brightness;
+    case SweepWarmth:
+        return &p.warmth;
+    case SweepLightness:
+        return &p.lightness;
+    case SweepLightnessRange:
+        return &p.lightness_range;
+    case SweepRotations:
+        return &p.rotations;
+    case SweepTemperature:
+        return &p.temperature;
+    case SweepTemperatureRange:
+        return &p.temperature_range;
+    case SweepGamma:
+        return &p.gamma;
+    case SweepPeriods:
+        return &p.periods;
+    }
+    return NULL;
+}
+
+float SweepValue(int ranges, const SweepRange* range, int point, int r)
+{
+    for (int i = ranges - 1; i > r; i--)
+        point /= range[i].steps;
+    int step = point % range[r].steps;
+    float value = range[r].first;
+    if (range[r].steps > 1)
+        value += step * (range[r].last - range[r].first) / (range[r].steps - 1);
+    return value;
+}
+
+Parameters SweepPoint(const Parameters& base, int ranges, const SweepRange* range, int point)
+{
+    Parameters p = base;
+    for (int r = 0; r < ranges; r++)
+        *sweep_field(p, range[r].parameter) = SweepValue(ranges, range, point, r);
+    return p;
+}
+
+float Uniformity(int n, const float* srgb_colormap)
+{
+    if (n < 2)
+        return 0.0f;
+    // the same measure as uniformity76 of Analyze()
+    std::vector<float> lab(3 * n);
+    SRGBToLAB(n, srgb_colormap, lab.data());
+    std::vector<float> delta_e(n - 1);
+    for (int i = 0; i < n - 1; i++)
+        delta_e[i] = DeltaE76(&lab[3 * i], &lab[3 * (i + 1)]);
+    return StepUniformity(n - 1, delta_e.data());
+}
+
+struct sweep_job {
+    const Parameters* base;
+    int ranges;
+    const SweepRange* range;
+    bool uniformity;
+    SweepResult* results;
+};
+
+static void sweep_points(void* data, int begin, int end)
+{
+    const sweep_job* j = static_cast<const sweep_job*>(data);
+    std::vector<float> colormap;
+    for (int i = begin; i < end; i++) {
+        Parameters p = SweepPoint(*(j->base), j->ranges, j->range, i);
+        colormap.resize(3 * p.n);
+        j->results[i].clipped = Generate(p, colormap.data());
+        j->results[i].uniformity = (j->uniformity ? Uniformity(p.n, colormap.data()) : 0.0f);
+    }
+}
+
+void Sweep(const Parameters& base, int ranges, const SweepRange* range,
+        bool uniformity, SweepResult* results)
+{
+    int points = SweepPoints(ranges, range);
+    if (points <= 0)
+        return;
+    sweep_job j;
+    j.base = &base;
+    j.ranges = ranges;
+    j.range = range;
+    j.uniformity = uniformity;
+    j.results = results;
+    ParallelFor(points, 1, sweep_points, &j);
+}
+
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019
+ * Computer Graphics Group, University of Siegen
+ * Written by Martin Lambers <martin.lambers@uni-siegen.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef COLORMAP_SWEEP_HPP
+#define COLORMAP_SWEEP_HPP
+
+#include "colormap.hpp"
+
+/* Parameter sweeps.
+ *
+ * A sweep evaluates a color map type on a regular grid in the space of its
+ * parameters, e.g. to find the parameter values that minimize clipping. Each
+ * range gives the values of one parameter; the grid consists of all
+ * combinations of these values, with the last range varying fastest. All other
+ * parameters are taken from a base Parameters record.
+ *
+ * The grid points are evaluated in parallel on the global thread pool (see
+ * SetThreads() in colormap.hpp). Each thread only keeps the color map it
+ * currently evaluates, so large grids need no more memory than the results.
+ */
+
+namespace ColorMap {
+
+enum SweepParameter {
+    SweepHue,
+    SweepDivergence,
+    SweepContrast,
+    SweepSaturation,
+    SweepSaturationRange,
+    SweepBrightness,
+    SweepWarmth,
+    SweepLightness,
+    SweepLightnessRange,
+    SweepRotations,
+    SweepTemperature,
+    SweepTemperatureRange,
+    SweepGamma,
+    SweepPeriods
+};
+
+struct SweepRange {
+    SweepParameter parameter;
+    float first;                // first value, in the units of the Parameters field
+    float last;                 // last value
+    int steps;                  // number of values; 1 means only the first value
+};
+
+struct SweepResult {
+    int clipped;                // number of clipped colors
+    float uniformity;           // see Uniformity(), or 0 if not requested
+};
+
+// Return the number of grid points, or -1 if there are more than INT_MAX or
+// a range has less than one step.
+
+int SweepPoints(int ranges, const SweepRange* range);
+
+// Return the value of range r at the given grid point.
+
+float SweepValue(int ranges, const SweepRange* range, int point, int r);
+
+// Return the parameters of the given grid point.
+
+Parameters SweepPoint(const Parameters& base, int ranges, const SweepRange* range, int point);
+
+// Evaluate all grid points. The results array must have room for
+// SweepPoints(ranges, range) entries. The uniformity metric is only computed
+// if requested.
+
+void Sweep(const Parameters& base, int ranges, const SweepRange* range,
+        bool uniformity, SweepResult* results);
+
+// Measure the perceptual uniformity of a color map with n sRGB colors in
+// [0,1]: the coefficient of variation (standard deviation divided by mean) of
+// the CIELAB distances between neighboring colors. A perfectly uniform map
+// gives 0. Maps with less than two colors, or with identical colors, give 0.
+
+float Uniformity(int n, const float* srgb_colormap);
+
+}
+
+#endif
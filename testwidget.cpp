@@ -24,9 +24,10 @@
 #include <cmath>
 
 #include <QGuiApplication>
-#include <QColor>
+#include <QMutex>
 
 #include "testwidget.hpp"
+#include "apply.hpp"
 
 
 /* Apply color map to test image. See
@@ -38,7 +39,7 @@ static const float twopi = 2.0 * M_PI;
 
 ColorMapTestWidget::ColorMapTestWidget() : QLabel()
 {
-    setMinimumSize(W * qApp->devicePixelRatio(), H * qApp->devicePixelRatio());
+    setMinimumSize(imageWidth(), imageHeight());
     QVector<unsigned char> initial_colormap(3, 0);
     update(initial_colormap);
 }
@@ -47,26 +48,64 @@ ColorMapTestWidget::~ColorMapTestWidget()
 {
 }
 
-void ColorMapTestWidget::update(const QVector<unsigned char>& colormap)
+int ColorMapTestWidget::imageWidth()
+{
+    return W * qApp->devicePixelRatio();
+}
+
+int ColorMapTestWidget::imageHeight()
+{
+    return H * qApp->devicePixelRatio();
+}
+
+/* The test pattern does not depend on the color map, so its values are
+ * computed only once for each image size. */
+
+static QMutex test_pattern_mutex;
+static int test_pattern_width = 0;
+static int test_pattern_height = 0;
+static QVector<float> test_pattern;
+
+static QVector<float> testPattern(int width, int height)
 {
-    QImage img(W * qApp->devicePixelRatio(), H * qApp->devicePixelRatio(), QImage::Format_RGB32);
-    for (int y = 0; y < img.height(); y++) {
-        QRgb* scanline = reinterpret_cast<QRgb*>(img.scanLine(y));
-        float v = 1.0f - (y / (img.height() - 1.0f));
-        for (int x = 0; x < img.width(); x++) {
-            float u = x / (img.width() - 1.0f);
-            // Test image formula
-            float ramp = u;
-            float modulation = 0.05f * std::sin(W / 8 * twopi * u);
-            float value = ramp + v * v * modulation;
-            // Applying colormap
-            int i = std::round(value * (colormap.size() / 3 - 1));
-            if (i < 0)
-                i = 0;
-            else if (i >= colormap.size() / 3)
-                i = colormap.size() / 3 - 1;
-            scanline[x] = QColor(colormap[3 * i + 0], colormap[3 * i + 1], colormap[3 * i + 2]).rgb();
+    QMutexLocker locker(&test_pattern_mutex);
+    if (width != test_pattern_width || height != test_pattern_height) {
+        QVector<float> pattern(width * height);
+        for (int y = 0; y < height; y++) {
+            float v = 1.0f - (y / (height - 1.0f));
+            for (int x = 0; x < width; x++) {
+                float u = x / (width - 1.0f);
+                // Test image formula
+                float ramp = u;
+                float modulation = 0.05f * std::sin(W / 8 * twopi * u);
+                pattern[y * width + x] = ramp + v * v * modulation;
+            }
         }
+        test_pattern = pattern;
+        test_pattern_width = width;
+        test_pattern_height = height;
     }
+    return test_pattern;
+}
+
+QImage ColorMapTestWidget::testImage(const QVector<unsigned char>& colormap, int width, int height)
+{
+    QVector<float> pattern = testPattern(width, height);
+    // Format_RGBX8888 has the same byte layout as RGBA output of ColorMap::Apply()
+    QImage img(width, height, QImage::Format_RGBX8888);
+    ColorMap::ApplyParameters parameters(0.0f, 1.0f);
+    parameters.channels = 4;
+    ColorMap::Apply(colormap.size() / 3, colormap.constData(), parameters,
+            width, height, pattern.constData(), 0, img.bits(), img.bytesPerLine());
+    return img;
+}
+
+void ColorMapTestWidget::setImage(const QImage& img)
+{
     setPixmap(QPixmap::fromImage(img));
 }
+
+void ColorMapTestWidget::update(const QVector<unsigned char>& colormap)
+{
+    setImage(testImage(colormap, imageWidth(), imageHeight()));
+}
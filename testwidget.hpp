@@ -25,6 +25,7 @@
 #define TESTWIDGET_HPP
 
 #include <QLabel>
+#include <QImage>
 #include <QVector>
 
 class ColorMapTestWidget : public QLabel
@@ -35,6 +36,18 @@ public:
     ColorMapTestWidget();
     ~ColorMapTestWidget();
 
+    /* Apply the color map to the test image of the given size. This does not
+     * touch any widget and can be called from any thread. */
+    static QImage testImage(const QVector<unsigned char>& colormap, int width, int height);
+
+    /* The size of the test image for the current display */
+    static int imageWidth();
+    static int imageHeight();
+
+    /* Show a test image computed with testImage() */
+    void setImage(const QImage& img);
+
+    /* Compute and show the test image for the given color map */
     void update(const QVector<unsigned char>& colormap);
 };
 